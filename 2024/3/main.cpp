@@ -1,94 +1,531 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
-#include <optional>
-#include <sstream>
+#include <limits>
+#include <queue>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
-bool checkCharacter(std::istream& stream, char character) {
-    bool result = stream.peek() == character;
+enum State : unsigned char {
+    START,
+    M,
+    MU,
+    MUL,
+    MUL_OPEN,
+    FIRST_1,
+    FIRST_2,
+    FIRST_3,
+    COMMA,
+    SECOND_1,
+    SECOND_2,
+    SECOND_3,
+    D,
+    DO,
+    DO_OPEN,
+    DON,
+    DON_APOSTROPHE,
+    DONT,
+    DONT_OPEN,
+    // accepting states, the scanner handles them and continues in START
+    EMIT_MUL,
+    EMIT_DO,
+    EMIT_DONT,
+    STATE_COUNT
+};
 
-    if (result)
-        stream.get();
+enum CharClass : unsigned char {
+    OTHER,
+    CHAR_M,
+    CHAR_U,
+    CHAR_L,
+    CHAR_D,
+    CHAR_O,
+    CHAR_N,
+    CHAR_APOSTROPHE,
+    CHAR_T,
+    CHAR_OPEN,
+    CHAR_CLOSE,
+    CHAR_COMMA,
+    CHAR_DIGIT,
+    CLASS_COUNT
+};
 
-    return result;
-}
+struct ScannerTable {
+    std::array<CharClass, 256> classes{};
+    std::array<std::array<State, CLASS_COUNT>, STATE_COUNT> transitions{};
+
+    constexpr ScannerTable() {
+        classes['m'] = CHAR_M;
+        classes['u'] = CHAR_U;
+        classes['l'] = CHAR_L;
+        classes['d'] = CHAR_D;
+        classes['o'] = CHAR_O;
+        classes['n'] = CHAR_N;
+        classes['\''] = CHAR_APOSTROPHE;
+        classes['t'] = CHAR_T;
+        classes['('] = CHAR_OPEN;
+        classes[')'] = CHAR_CLOSE;
+        classes[','] = CHAR_COMMA;
+        for (char ch = '0'; ch <= '9'; ch++) {
+            classes[ch] = CHAR_DIGIT;
+        }
 
-bool checkString(std::istream& stream, const std::string& str) {
-    for (const char ch : str) {
-        if (!checkCharacter(stream, ch)) {
-            return false;
+        // 'm' and 'd' only occur as the first character of an instruction, so
+        // every mismatch can restart from the START row instead of backtracking
+        for (auto& row : transitions) {
+            row.fill(START);
+            row[CHAR_M] = M;
+            row[CHAR_D] = D;
         }
+
+        transitions[M][CHAR_U] = MU;
+        transitions[MU][CHAR_L] = MUL;
+        transitions[MUL][CHAR_OPEN] = MUL_OPEN;
+        transitions[MUL_OPEN][CHAR_DIGIT] = FIRST_1;
+        transitions[FIRST_1][CHAR_DIGIT] = FIRST_2;
+        transitions[FIRST_2][CHAR_DIGIT] = FIRST_3;
+        transitions[FIRST_1][CHAR_COMMA] = COMMA;
+        transitions[FIRST_2][CHAR_COMMA] = COMMA;
+        transitions[FIRST_3][CHAR_COMMA] = COMMA;
+        transitions[COMMA][CHAR_DIGIT] = SECOND_1;
+        transitions[SECOND_1][CHAR_DIGIT] = SECOND_2;
+        transitions[SECOND_2][CHAR_DIGIT] = SECOND_3;
+        transitions[SECOND_1][CHAR_CLOSE] = EMIT_MUL;
+        transitions[SECOND_2][CHAR_CLOSE] = EMIT_MUL;
+        transitions[SECOND_3][CHAR_CLOSE] = EMIT_MUL;
+
+        transitions[D][CHAR_O] = DO;
+        transitions[DO][CHAR_OPEN] = DO_OPEN;
+        transitions[DO_OPEN][CHAR_CLOSE] = EMIT_DO;
+        transitions[DO][CHAR_N] = DON;
+        transitions[DON][CHAR_APOSTROPHE] = DON_APOSTROPHE;
+        transitions[DON_APOSTROPHE][CHAR_T] = DONT;
+        transitions[DONT][CHAR_OPEN] = DONT_OPEN;
+        transitions[DONT_OPEN][CHAR_CLOSE] = EMIT_DONT;
     }
+};
 
-    return true;
+static constexpr ScannerTable scannerTable;
+
+// the products of a scanned range, enabled and finalEnabled are indexed by the
+// enable state the range is entered with, so ranges can be scanned independently
+struct ScanResult {
+    std::uint64_t total = 0;
+    std::uint64_t enabled[2] = {0, 0};
+    bool finalEnabled[2] = {false, true};
+};
+
+ScanResult combine(const ScanResult& left, const ScanResult& right) {
+    ScanResult result;
+    result.total = left.total + right.total;
+
+    for (int start = 0; start < 2; start++) {
+        const bool middle = left.finalEnabled[start];
+        result.enabled[start] = left.enabled[start] + right.enabled[middle];
+        result.finalEnabled[start] = right.finalEnabled[middle];
+    }
+
+    return result;
 }
 
-bool getNumber(std::istream& stream, int* result) {
-    char next = stream.peek();
-    if (next >= '0' && next <= '9') {
-        stream >> *result;
-        return *result < 1000;
+// returns the next byte an instruction can start at, nextM and nextD cache the
+// last memchr results so each byte is searched at most once per character.
+// nullptr means the character has not been searched for yet
+const char* findCandidate(const char* pos, const char* end, const char*& nextM, const char*& nextD) {
+    if (nextM == nullptr || nextM < pos) {
+        nextM = static_cast<const char*>(std::memchr(pos, 'm', end - pos));
+        if (nextM == nullptr)
+            nextM = end;
     }
 
-    return false;
+    if (nextD == nullptr || nextD < pos) {
+        nextD = static_cast<const char*>(std::memchr(pos, 'd', end - pos));
+        if (nextD == nullptr)
+            nextD = end;
+    }
+
+    return std::min(nextM, nextD);
 }
 
-void skipDisabled(std::stringstream& stream) {
-    while (stream.tellg() != -1) {
-        if (checkString(stream, "do()")) {
-            return;
+// scans all instructions starting in [begin, tokensEnd), an instruction started
+// before tokensEnd may be read up to limit
+ScanResult scanMemory(const char* begin, const char* tokensEnd, const char* limit) {
+    ScanResult result;
+    bool* enabled = result.finalEnabled;
+
+    State state = START;
+    std::uint64_t first = 0, second = 0;
+    const char* nextM = nullptr;
+    const char* nextD = nullptr;
+
+    for (const char* pos = begin; pos < limit; pos++) {
+        if (state == START) {
+            if (pos >= tokensEnd)
+                break;
+
+            pos = findCandidate(pos, tokensEnd, nextM, nextD);
+            if (pos == tokensEnd)
+                break;
         }
-        stream.get();
+
+        const unsigned char ch = *pos;
+        state = scannerTable.transitions[state][scannerTable.classes[ch]];
+
+        switch (state) {
+            case M:
+            case D:
+                // the instruction starting here belongs to the next range
+                if (pos >= tokensEnd)
+                    return result;
+                break;
+            case FIRST_1:
+                first = ch - '0';
+                break;
+            case FIRST_2:
+            case FIRST_3:
+                first = first * 10 + (ch - '0');
+                break;
+            case SECOND_1:
+                second = ch - '0';
+                break;
+            case SECOND_2:
+            case SECOND_3:
+                second = second * 10 + (ch - '0');
+                break;
+            case EMIT_MUL:
+                result.total += first * second;
+                for (int start = 0; start < 2; start++) {
+                    if (enabled[start])
+                        result.enabled[start] += first * second;
+                }
+
+                state = START;
+                break;
+            case EMIT_DO:
+                enabled[0] = enabled[1] = true;
+                state = START;
+                break;
+            case EMIT_DONT:
+                enabled[0] = enabled[1] = false;
+                state = START;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return result;
+}
+
+ScanResult scanMemory(const char* begin, const char* end) {
+    return scanMemory(begin, end, end);
+}
+
+// splits the memory into one chunk per thread, each chunk owns the instructions
+// starting inside it and reads past its end to finish the last one
+ScanResult scanMemoryParallel(const char* begin, const char* end, unsigned int threadsCount) {
+    const std::size_t size = end - begin;
+    threadsCount = std::max(1u, static_cast<unsigned int>(std::min<std::size_t>(threadsCount, size)));
+    const std::size_t chunkSize = (size + threadsCount - 1) / threadsCount;
+
+    std::vector<ScanResult> results(threadsCount);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < threadsCount; i++) {
+        const char* chunkBegin = begin + std::min(size, i * chunkSize);
+        const char* chunkEnd = begin + std::min(size, (i + 1) * chunkSize);
+
+        threads.emplace_back([&results, i, chunkBegin, chunkEnd, end]() {
+            results[i] = scanMemory(chunkBegin, chunkEnd, end);
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
     }
+
+    // prefix scan over the chunks, each chunk continues in the state its predecessor ended in
+    ScanResult result = results[0];
+    for (unsigned int i = 1; i < threadsCount; i++) {
+        result = combine(result, results[i]);
+    }
+
+    return result;
 }
 
-int getNextMultiplication(std::stringstream& stream) {
-    if (stream.tellg() == -1)
-        return 0;
+struct Instruction {
+    std::string name;
+    int argsCount;
+    // every operand is a decimal number with 1 to maxDigits digits and at most maxValue
+    int maxDigits = 3;
+    std::uint64_t maxValue = std::numeric_limits<std::uint64_t>::max();
+    std::function<void(std::span<const std::uint64_t>)> handler;
+};
+
+// recognizes a set of name(arg,...) instructions in one pass, the "name(" prefixes
+// are matched by an Aho-Corasick automaton and the operands are parsed from there
+struct InstructionSet {
+    std::vector<Instruction> instructions;
+
+    std::array<int, 256> classes{};
+    int classesCount = 1;
+    std::array<bool, 256> startCharacters{};
+
+    // transitions[node * classesCount + class], every node is complete after compile()
+    std::vector<int> transitions;
+    std::vector<int> fail;
+    // index of the first instruction whose prefix ends at a node or -1, outputLink is
+    // the next node on the fail chain that has an output
+    std::vector<int> output;
+    std::vector<int> outputLink;
+    // next instruction with the same name or -1, overloads share a trie node
+    std::vector<int> overloads;
+
+    void add(const Instruction& instruction) {
+        instructions.push_back(instruction);
+    }
+
+    int addNode() {
+        transitions.resize(transitions.size() + classesCount, 0);
+        fail.push_back(0);
+        output.push_back(-1);
+        outputLink.push_back(-1);
+
+        return fail.size() - 1;
+    }
+
+    void compile() {
+        classes.fill(0);
+        classesCount = 1;
+        startCharacters.fill(false);
+        for (const Instruction& instruction : instructions) {
+            for (const unsigned char ch : instruction.name + "(") {
+                if (classes[ch] == 0)
+                    classes[ch] = classesCount++;
+            }
 
-    // find the next m
-    while (stream.tellg() != -1) {
-        if (checkString(stream, "mul(")) {
-            break;
+            startCharacters[static_cast<unsigned char>((instruction.name + "(")[0])] = true;
         }
-        else if (checkString(stream, "don't()")) {
-            skipDisabled(stream);
+
+        transitions.clear();
+        fail.clear();
+        output.clear();
+        outputLink.clear();
+        overloads.assign(instructions.size(), -1);
+        addNode();
+
+        // build the trie, edge 0 is the "other" class and always leads back to the root
+        for (int i = 0; i < instructions.size(); i++) {
+            int node = 0;
+            for (const unsigned char ch : instructions[i].name + "(") {
+                const int edge = node * classesCount + classes[ch];
+                if (transitions[edge] == 0) {
+                    // addNode() grows transitions, so the edge is written after it returns
+                    const int created = addNode();
+                    transitions[edge] = created;
+                }
+
+                node = transitions[edge];
+            }
+
+            int* last = &output[node];
+            while (*last >= 0) {
+                last = &overloads[*last];
+            }
+
+            *last = i;
+        }
+
+        // breadth first over the trie to fill in fail links and the missing transitions
+        std::queue<int> nodes;
+        for (int c = 1; c < classesCount; c++) {
+            if (transitions[c] != 0)
+                nodes.push(transitions[c]);
         }
-        else {
-            stream.get();
+
+        while (!nodes.empty()) {
+            int node = nodes.front();
+            nodes.pop();
+
+            outputLink[node] = output[fail[node]] >= 0 ? fail[node] : outputLink[fail[node]];
+
+            for (int c = 1; c < classesCount; c++) {
+                int& next = transitions[node * classesCount + c];
+                const int fallback = transitions[fail[node] * classesCount + c];
+
+                if (next == 0) {
+                    next = fallback;
+                }
+                else {
+                    fail[next] = fallback;
+                    nodes.push(next);
+                }
+            }
         }
     }
 
-    int first, second;
-    if (!getNumber(stream, &first)) {
-        return getNextMultiplication(stream);
+    // parses "arg,...)" starting at pos, returns false if the operands do not match the instruction
+    bool parseArguments(const char* pos, const char* end, const Instruction& instruction, std::uint64_t* args) const {
+        for (int i = 0; i < instruction.argsCount; i++) {
+            if (i > 0) {
+                if (pos == end || *pos != ',')
+                    return false;
+                pos++;
+            }
+
+            int digits = 0;
+            std::uint64_t value = 0;
+            while (pos != end && *pos >= '0' && *pos <= '9') {
+                if (++digits > instruction.maxDigits)
+                    return false;
+
+                const std::uint64_t digit = *pos - '0';
+                if (value > (instruction.maxValue - digit) / 10)
+                    return false;
+
+                value = value * 10 + digit;
+                pos++;
+            }
+
+            if (digits == 0)
+                return false;
+
+            args[i] = value;
+        }
+
+        return pos != end && *pos == ')';
     }
 
-    if (!checkCharacter(stream, ',')) {
-        return getNextMultiplication(stream);
+    void scan(const char* begin, const char* end) const {
+        std::vector<std::uint64_t> args;
+        for (const Instruction& instruction : instructions) {
+            args.resize(std::max<std::size_t>(args.size(), instruction.argsCount));
+        }
+
+        int node = 0;
+        for (const char* pos = begin; pos < end; pos++) {
+            const unsigned char ch = *pos;
+            if (node == 0 && !startCharacters[ch])
+                continue;
+
+            node = transitions[node * classesCount + classes[ch]];
+
+            for (int match = output[node] >= 0 ? node : outputLink[node]; match >= 0; match = outputLink[match]) {
+                for (int index = output[match]; index >= 0; index = overloads[index]) {
+                    const Instruction& instruction = instructions[index];
+                    if (parseArguments(pos + 1, end, instruction, args.data())) {
+                        instruction.handler(std::span<const std::uint64_t>(args.data(), instruction.argsCount));
+                    }
+                }
+            }
+        }
     }
+};
 
-    if (!getNumber(stream, &second)) {
-        return getNextMultiplication(stream);
+// returns an empty memory if the file can not be read
+std::string readMemory(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file)
+        return std::string();
+
+    const std::streamoff size = file.tellg();
+    if (size < 0)
+        return std::string();
+
+    std::string memory(size, '\0');
+
+    file.seekg(0);
+    file.read(memory.data(), memory.size());
+
+    return memory;
+}
+
+struct InstructionStatistics {
+    std::uint64_t count = 0;
+    std::uint64_t productsSum = 0;
+};
+
+// parses a comma separated list of name/argsCount[/maxDigits] entries
+InstructionSet parseInstructionSet(std::string_view spec, std::vector<InstructionStatistics>& statistics) {
+    InstructionSet instructionSet;
+    std::vector<std::string_view> entries;
+
+    while (!spec.empty()) {
+        std::size_t split = spec.find(',');
+        entries.push_back(spec.substr(0, split));
+        spec = split == std::string_view::npos ? std::string_view() : spec.substr(split + 1);
     }
 
-    if (!checkCharacter(stream, ')')) {
-        return getNextMultiplication(stream);
+    statistics.resize(entries.size());
+    for (int i = 0; i < entries.size(); i++) {
+        std::string_view entry = entries[i];
+        std::size_t argsStart = entry.find('/');
+        std::size_t digitsStart = entry.find('/', argsStart + 1);
+
+        Instruction instruction;
+        instruction.name = entry.substr(0, argsStart);
+        instruction.argsCount = argsStart == std::string_view::npos ? 0 : std::stoi(std::string(entry.substr(argsStart + 1)));
+        if (digitsStart != std::string_view::npos) {
+            instruction.maxDigits = std::stoi(std::string(entry.substr(digitsStart + 1)));
+        }
+
+        InstructionStatistics* instructionStatistics = &statistics[i];
+        instruction.handler = [instructionStatistics](std::span<const std::uint64_t> args) {
+            std::uint64_t product = 1;
+            for (const std::uint64_t arg : args) {
+                product *= arg;
+            }
+
+            instructionStatistics->count++;
+            instructionStatistics->productsSum += product;
+        };
+
+        instructionSet.add(instruction);
     }
 
-    return first * second;
+    instructionSet.compile();
+    return instructionSet;
 }
 
 int main(int argC, char** argV) {
-    std::fstream inputFile("input.txt");
-    std::stringstream stream;
-    stream << inputFile.rdbuf();
+    unsigned int threadsCount = 0;
+    std::string_view instructionsSpec;
+    for (int i = 1; i < argC; i++) {
+        std::string_view arg = argV[i];
+        if (arg.starts_with("--threads=")) {
+            threadsCount = std::stoi(std::string(arg.substr(10)));
+        }
+        else if (arg.starts_with("--instructions=")) {
+            instructionsSpec = arg.substr(15);
+        }
+    }
+
+    const std::string memory = readMemory("input.txt");
+    const char* begin = memory.data();
+    const char* end = begin + memory.size();
 
-    int sum = 0;
-    while (stream.tellg() != -1) {
-        sum += getNextMultiplication(stream);
+    if (!instructionsSpec.empty()) {
+        std::vector<InstructionStatistics> statistics;
+        InstructionSet instructionSet = parseInstructionSet(instructionsSpec, statistics);
+        instructionSet.scan(begin, end);
+
+        for (int i = 0; i < statistics.size(); i++) {
+            std::cout << instructionSet.instructions[i].name << ": " << statistics[i].count << " matches, sum of products " << statistics[i].productsSum << std::endl;
+        }
+
+        return 0;
     }
 
-    std::cout << "Sum: " << sum << std::endl;
+    ScanResult result = threadsCount > 0 ? scanMemoryParallel(begin, end, threadsCount) : scanMemory(begin, end);
+
+    std::cout << "Sum: " << result.total << std::endl;
+    std::cout << "Sum of enabled multiplications: " << result.enabled[true] << std::endl;
 }
 
 // 108165515
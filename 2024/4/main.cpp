@@ -1,6 +1,17 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <fileRead.hpp>
 #include <fstream>
 #include <iostream>
+#include <queue>
+#include <random>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 char** readFile(const std::string& filename, int* linesCount, int* lineLength) {
@@ -102,7 +113,418 @@ int countX_MAS(char** characters, int linesCount, int lineLength) {
     return totalMatches;
 }
 
+// one bit plane per letter of "XMAS", bit x % 64 of word y * wordsPerRow + x / 64
+// is set if the letter is at (x, y), bits past the last column stay zero
+struct BitGrid {
+    static constexpr char letters[] = {'X', 'M', 'A', 'S'};
+
+    int width = 0;
+    int height = 0;
+    int wordsPerRow = 0;
+    std::vector<std::uint64_t> planes[4];
+
+    static BitGrid fromLines(const std::vector<std::string>& lines) {
+        BitGrid grid;
+        grid.height = lines.size();
+        grid.width = lines[0].size();
+        grid.wordsPerRow = (grid.width + 63) / 64;
+
+        for (auto& plane : grid.planes) {
+            plane.assign(static_cast<std::size_t>(grid.wordsPerRow) * grid.height, 0);
+        }
+
+        for (int y = 0; y < grid.height; y++) {
+            for (int x = 0; x < grid.width; x++) {
+                for (int letter = 0; letter < 4; letter++) {
+                    if (lines[y][x] == letters[letter]) {
+                        grid.planes[letter][static_cast<std::size_t>(y) * grid.wordsPerRow + x / 64] |= std::uint64_t(1) << (x % 64);
+                    }
+                }
+            }
+        }
+
+        return grid;
+    }
+
+    static BitGrid random(int width, int height, unsigned int seed) {
+        BitGrid grid;
+        grid.width = width;
+        grid.height = height;
+        grid.wordsPerRow = (width + 63) / 64;
+
+        for (auto& plane : grid.planes) {
+            plane.resize(static_cast<std::size_t>(grid.wordsPerRow) * height);
+        }
+
+        // two random bits pick one of the four letters for every cell
+        std::mt19937_64 generator(seed);
+        for (int y = 0; y < height; y++) {
+            for (int w = 0; w < grid.wordsPerRow; w++) {
+                std::uint64_t mask = ~std::uint64_t(0);
+                if (w == grid.wordsPerRow - 1 && width % 64 != 0)
+                    mask = (std::uint64_t(1) << (width % 64)) - 1;
+
+                const std::uint64_t low = generator();
+                const std::uint64_t high = generator();
+                const std::size_t index = static_cast<std::size_t>(y) * grid.wordsPerRow + w;
+
+                grid.planes[0][index] = ~high & ~low & mask;
+                grid.planes[1][index] = ~high & low & mask;
+                grid.planes[2][index] = high & ~low & mask;
+                grid.planes[3][index] = high & low & mask;
+            }
+        }
+
+        return grid;
+    }
+
+    // word of the given row with bit i holding column 64 * word + i + shift
+    std::uint64_t shiftedWord(int letter, int y, int word, int shift) const {
+        const std::uint64_t* row = planes[letter].data() + static_cast<std::size_t>(y) * wordsPerRow;
+
+        if (shift > 0) {
+            std::uint64_t result = row[word] >> shift;
+            if (word + 1 < wordsPerRow)
+                result |= row[word + 1] << (64 - shift);
+            return result;
+        }
+        else if (shift < 0) {
+            std::uint64_t result = row[word] << -shift;
+            if (word > 0)
+                result |= row[word - 1] >> (64 + shift);
+            return result;
+        }
+
+        return row[word];
+    }
+
+    // counts the positions (x, y) with rowBegin <= y < rowEnd where letter i of word
+    // lies at (x + i * dx, y + i * dy)
+    long long countWord(const int* word, int dx, int dy, int rowBegin, int rowEnd) const {
+        long long matches = 0;
+
+        for (int y = rowBegin; y < rowEnd && y + 3 * dy < height; y++) {
+            for (int w = 0; w < wordsPerRow; w++) {
+                std::uint64_t match = shiftedWord(word[0], y, w, 0);
+                for (int i = 1; i < 4 && match; i++) {
+                    match &= shiftedWord(word[i], y + i * dy, w, i * dx);
+                }
+
+                matches += std::popcount(match);
+            }
+        }
+
+        return matches;
+    }
+};
+
+// counts the matches whose first letter lies in rows [rowBegin, rowEnd), so
+// disjoint row bands never count a match twice
+long long countXMAS(const BitGrid& grid, int rowBegin, int rowEnd) {
+    static constexpr int xmas[] = {0, 1, 2, 3};
+    static constexpr int samx[] = {3, 2, 1, 0};
+    static constexpr int directions[][2] = {{1, 0}, {0, 1}, {1, 1}, {-1, 1}};
+
+    // every line is searched in one direction, "SAMX" covers the opposite one
+    long long totalMatches = 0;
+    for (const auto& [dx, dy] : directions) {
+        totalMatches += grid.countWord(xmas, dx, dy, rowBegin, rowEnd);
+        totalMatches += grid.countWord(samx, dx, dy, rowBegin, rowEnd);
+    }
+
+    return totalMatches;
+}
+
+// counts the matches whose 'A' lies in rows [rowBegin, rowEnd)
+long long countX_MAS(const BitGrid& grid, int rowBegin, int rowEnd) {
+    static constexpr int M = 1, A = 2, S = 3;
+    long long totalMatches = 0;
+
+    for (int y = std::max(rowBegin, 1); y < rowEnd && y + 1 < grid.height; y++) {
+        for (int w = 0; w < grid.wordsPerRow; w++) {
+            std::uint64_t centers = grid.shiftedWord(A, y, w, 0);
+            if (!centers)
+                continue;
+
+            const std::uint64_t diagonal =
+                (grid.shiftedWord(M, y - 1, w, -1) & grid.shiftedWord(S, y + 1, w, 1)) |
+                (grid.shiftedWord(S, y - 1, w, -1) & grid.shiftedWord(M, y + 1, w, 1));
+            const std::uint64_t antiDiagonal =
+                (grid.shiftedWord(M, y + 1, w, -1) & grid.shiftedWord(S, y - 1, w, 1)) |
+                (grid.shiftedWord(S, y + 1, w, -1) & grid.shiftedWord(M, y - 1, w, 1));
+
+            totalMatches += std::popcount(centers & diagonal & antiDiagonal);
+        }
+    }
+
+    return totalMatches;
+}
+
+long long countXMAS(const BitGrid& grid) {
+    return countXMAS(grid, 0, grid.height);
+}
+
+long long countX_MAS(const BitGrid& grid) {
+    return countX_MAS(grid, 0, grid.height);
+}
+
+struct Matches {
+    long long xmas = 0;
+    long long x_mas = 0;
+};
+
+// splits the grid into bands of rows that are counted by a pool of threads. Every
+// band reads up to three rows past its edges, but a match only counts in the band
+// that contains its anchor row, so the bands need no further stitching
+Matches countParallel(const BitGrid& grid, unsigned int threadsCount, int bandRows = 256) {
+    struct alignas(64) ThreadMatches {
+        Matches matches;
+    };
+
+    const int bandsCount = (grid.height + bandRows - 1) / bandRows;
+    std::atomic<int> nextBand = 0;
+    std::vector<ThreadMatches> threadMatches(threadsCount);
+
+    auto worker = [&](ThreadMatches& local) {
+        for (int band = nextBand++; band < bandsCount; band = nextBand++) {
+            const int rowBegin = band * bandRows;
+            const int rowEnd = std::min(grid.height, rowBegin + bandRows);
+
+            local.matches.xmas += countXMAS(grid, rowBegin, rowEnd);
+            local.matches.x_mas += countX_MAS(grid, rowBegin, rowEnd);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < threadsCount; i++) {
+        threads.emplace_back(worker, std::ref(threadMatches[i]));
+    }
+
+    Matches total;
+    for (unsigned int i = 0; i < threadsCount; i++) {
+        threads[i].join();
+        total.xmas += threadMatches[i].matches.xmas;
+        total.x_mas += threadMatches[i].matches.x_mas;
+    }
+
+    return total;
+}
+
+void benchmark(int size) {
+    auto start = std::chrono::steady_clock::now();
+    BitGrid grid = BitGrid::random(size, size, 4);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Generated " << size << "x" << size << " grid in " << elapsed.count() << " s" << std::endl;
+
+    double singleThreaded = 0;
+    for (unsigned int threadsCount = 1; threadsCount <= 64; threadsCount *= 2) {
+        start = std::chrono::steady_clock::now();
+        Matches matches = countParallel(grid, threadsCount);
+        elapsed = std::chrono::steady_clock::now() - start;
+
+        if (threadsCount == 1)
+            singleThreaded = elapsed.count();
+
+        std::cout << threadsCount << " threads: " << elapsed.count() << " s, speedup " << singleThreaded / elapsed.count()
+                  << " (" << matches.xmas << " XMAS, " << matches.x_mas << " X-MAS)" << std::endl;
+    }
+}
+
+// counts a dictionary of words in all eight directions, every row, column, diagonal
+// and anti-diagonal is streamed once through an Aho-Corasick automaton that
+// contains each word and its reverse
+struct WordCounter {
+    std::vector<std::string> words;
+
+    std::array<int, 256> classes{};
+    int classesCount = 1;
+
+    // transitions[node * classesCount + class], complete after construction
+    std::vector<int> transitions;
+    std::vector<int> fail;
+    std::vector<int> bfsOrder;
+    // node the word and its reverse end in, equal for palindromes
+    std::vector<int> forwardNodes;
+    std::vector<int> reverseNodes;
+
+    WordCounter(const std::vector<std::string>& words)
+        : words(words) {
+        for (const std::string& word : words) {
+            for (const unsigned char ch : word) {
+                if (classes[ch] == 0)
+                    classes[ch] = classesCount++;
+            }
+        }
+
+        addNode();
+        for (const std::string& word : words) {
+            forwardNodes.push_back(insert(word));
+            reverseNodes.push_back(insert(std::string(word.rbegin(), word.rend())));
+        }
+
+        std::queue<int> nodes;
+        for (int c = 1; c < classesCount; c++) {
+            if (transitions[c] != 0)
+                nodes.push(transitions[c]);
+        }
+
+        while (!nodes.empty()) {
+            int node = nodes.front();
+            nodes.pop();
+            bfsOrder.push_back(node);
+
+            for (int c = 1; c < classesCount; c++) {
+                int& next = transitions[node * classesCount + c];
+                const int fallback = transitions[fail[node] * classesCount + c];
+
+                if (next == 0) {
+                    next = fallback;
+                }
+                else {
+                    fail[next] = fallback;
+                    nodes.push(next);
+                }
+            }
+        }
+    }
+
+    int addNode() {
+        transitions.resize(transitions.size() + classesCount, 0);
+        fail.push_back(0);
+
+        return fail.size() - 1;
+    }
+
+    int insert(const std::string& pattern) {
+        int node = 0;
+        for (const unsigned char ch : pattern) {
+            const int edge = node * classesCount + classes[ch];
+            if (transitions[edge] == 0) {
+                const int created = addNode();
+                transitions[edge] = created;
+            }
+
+            node = transitions[edge];
+        }
+
+        return node;
+    }
+
+    // streams all lines of the grid through the automaton, hits[node] counts how
+    // often the automaton was in node
+    void countHits(const std::vector<std::string>& lines, std::vector<long long>& hits) const {
+        const int height = lines.size();
+        const int width = lines[0].size();
+
+        auto streamLine = [&](int x, int y, int dx, int dy) {
+            int node = 0;
+            for (; x >= 0 && x < width && y < height; x += dx, y += dy) {
+                node = transitions[node * classesCount + classes[static_cast<unsigned char>(lines[y][x])]];
+                hits[node]++;
+            }
+        };
+
+        for (int y = 0; y < height; y++) {
+            streamLine(0, y, 1, 0);
+        }
+
+        for (int x = 0; x < width; x++) {
+            streamLine(x, 0, 0, 1);
+        }
+
+        // diagonals start in the top row or the left column, anti-diagonals in the top row or the right column
+        for (int x = 0; x < width; x++) {
+            streamLine(x, 0, 1, 1);
+            streamLine(x, 0, -1, 1);
+        }
+
+        for (int y = 1; y < height; y++) {
+            streamLine(0, y, 1, 1);
+            streamLine(width - 1, y, -1, 1);
+        }
+    }
+
+    std::vector<long long> count(const std::vector<std::string>& lines, bool palindromesOnce = false) const {
+        std::vector<long long> hits(fail.size(), 0);
+        countHits(lines, hits);
+
+        // every match of a pattern is also a match of the patterns along its fail chain
+        for (auto it = bfsOrder.rbegin(); it != bfsOrder.rend(); it++) {
+            hits[fail[*it]] += hits[*it];
+        }
+
+        std::vector<long long> counts;
+        for (int i = 0; i < words.size(); i++) {
+            if (forwardNodes[i] == reverseNodes[i] && palindromesOnce) {
+                counts.push_back(hits[forwardNodes[i]]);
+            }
+            else {
+                counts.push_back(hits[forwardNodes[i]] + hits[reverseNodes[i]]);
+            }
+        }
+
+        return counts;
+    }
+};
+
 int main(int argC, char** argV) {
+    bool scalar = false;
+    bool palindromesOnce = false;
+    unsigned int threadsCount = 0;
+    std::vector<std::string> words;
+    for (int i = 1; i < argC; i++) {
+        std::string_view arg = argV[i];
+        if (arg == "--scalar") {
+            scalar = true;
+        }
+        else if (arg == "--palindromes-once") {
+            palindromesOnce = true;
+        }
+        else if (arg.starts_with("--threads=")) {
+            threadsCount = std::stoi(std::string(arg.substr(10)));
+        }
+        else if (arg.starts_with("--bench=")) {
+            benchmark(std::stoi(std::string(arg.substr(8))));
+            return 0;
+        }
+        else if (arg.starts_with("--words=")) {
+            arg = arg.substr(8);
+            while (!arg.empty()) {
+                std::size_t split = arg.find(',');
+                words.emplace_back(arg.substr(0, split));
+                arg = split == std::string_view::npos ? std::string_view() : arg.substr(split + 1);
+            }
+        }
+    }
+
+    if (!words.empty()) {
+        std::vector<std::string> lines = readLines("input.txt");
+        WordCounter counter(words);
+        std::vector<long long> counts = counter.count(lines, palindromesOnce);
+
+        for (int i = 0; i < words.size(); i++) {
+            std::cout << "Total \"" << words[i] << "\" matches: " << counts[i] << std::endl;
+        }
+        return 0;
+    }
+
+    if (!scalar) {
+        BitGrid grid = BitGrid::fromLines(readLines("input.txt"));
+
+        Matches matches;
+        if (threadsCount > 0) {
+            matches = countParallel(grid, threadsCount);
+        }
+        else {
+            matches = {countXMAS(grid), countX_MAS(grid)};
+        }
+
+        std::cout << "Total \"XMAS\" matches: " << matches.xmas << std::endl;
+
+        std::cout << "Total \"X-MAS\" matches: " << matches.x_mas << std::endl;
+        return 0;
+    }
+
     int linesCount, lineLength;
     char** characters = readFile("input.txt", &linesCount, &lineLength);
 
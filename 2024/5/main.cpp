@@ -1,8 +1,18 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <numeric>
+#include <optional>
+#include <random>
 #include <set>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using PageOrderingRules = std::map<int, std::set<int>>;
@@ -59,57 +69,530 @@ bool checkQueue(const PrintQueue& queue, const PageOrderingRules& rules) {
     return true;
 }
 
-void sortQueue(PrintQueue& queue, const PageOrderingRules& rules) {
-    for (int i = 1; i < queue.size();) {
-        int currentPage = queue[i];
-        if (!rules.contains(currentPage)) {
-            i++;
-            continue;
+// the ordering rules as a relation before(a, b), stored as a bit matrix while all
+// page numbers are small and as a hash set of packed page pairs otherwise
+struct RuleMatrix {
+    static constexpr int denseLimit = 4096;
+
+    bool dense = true;
+    int size = 0;
+    int wordsPerRow = 0;
+    // bit b of row a is set if a has to be printed before b
+    std::vector<std::uint64_t> bits;
+    std::unordered_set<std::uint64_t> pairs;
+    // number of page pairs with rules in both directions
+    int conflicts = 0;
+
+    static RuleMatrix fromRules(const PageOrderingRules& rules) {
+        RuleMatrix matrix;
+        for (const auto& [page, followingPages] : rules) {
+            for (const int followingPage : followingPages) {
+                matrix.addRule(page, followingPage);
+            }
+        }
+
+        return matrix;
+    }
+
+    static std::uint64_t pairKey(int first, int second) {
+        return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(first)) << 32) | static_cast<std::uint32_t>(second);
+    }
+
+    void grow(int page) {
+        if (page < 0 || page >= denseLimit) {
+            // move all rules to the hash set
+            for (int a = 0; a < size; a++) {
+                for (int b = 0; b < size; b++) {
+                    if (before(a, b))
+                        pairs.insert(pairKey(a, b));
+                }
+            }
+
+            dense = false;
+            bits.clear();
+            return;
+        }
+
+        RuleMatrix grown;
+        grown.size = std::max(page + 1, std::min(2 * size, static_cast<int>(denseLimit)));
+        grown.wordsPerRow = (grown.size + 63) / 64;
+        grown.bits.assign(static_cast<std::size_t>(grown.size) * grown.wordsPerRow, 0);
+        grown.conflicts = conflicts;
+
+        for (int a = 0; a < size; a++) {
+            std::copy_n(&bits[static_cast<std::size_t>(a) * wordsPerRow], wordsPerRow, &grown.bits[static_cast<std::size_t>(a) * grown.wordsPerRow]);
+        }
+
+        *this = std::move(grown);
+    }
+
+    void addRule(int first, int second) {
+        if (dense && std::min(first, second) < 0) {
+            grow(-1);
+        }
+        else if (dense && std::max(first, second) >= size) {
+            grow(std::max(first, second));
+        }
+
+        if (before(first, second))
+            return;
+
+        if (before(second, first))
+            conflicts++;
+
+        if (dense) {
+            bits[static_cast<std::size_t>(first) * wordsPerRow + second / 64] |= std::uint64_t(1) << (second % 64);
+        }
+        else {
+            pairs.insert(pairKey(first, second));
+        }
+    }
+
+    bool removeRule(int first, int second) {
+        if (!before(first, second))
+            return false;
+
+        if (before(second, first))
+            conflicts--;
+
+        if (dense) {
+            bits[static_cast<std::size_t>(first) * wordsPerRow + second / 64] &= ~(std::uint64_t(1) << (second % 64));
+        }
+        else {
+            pairs.erase(pairKey(first, second));
         }
 
-        int swapIndex = -1;
+        return true;
+    }
+
+    bool before(int first, int second) const {
+        if (dense) {
+            if (first < 0 || second < 0 || first >= size || second >= size)
+                return false;
+
+            return bits[static_cast<std::size_t>(first) * wordsPerRow + second / 64] >> (second % 64) & 1;
+        }
+
+        return pairs.contains(pairKey(first, second));
+    }
+
+    const std::uint64_t* row(int page) const {
+        return &bits[static_cast<std::size_t>(page) * wordsPerRow];
+    }
+};
+
+bool checkQueue(const PrintQueue& queue, const RuleMatrix& rules) {
+    for (int i = 1; i < queue.size(); i++) {
         for (int j = 0; j < i; j++) {
-            if (rules.at(currentPage).contains(queue[j])) {
-                queue[i] = queue[j];
-                queue[j] = currentPage;
-                swapIndex = j;
+            if (rules.before(queue[i], queue[j])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// only valid if the rules order every pair of pages in the queue and are
+// transitive on it, then the queue is sorted iff every adjacent pair is
+bool checkQueueTotalOrder(const PrintQueue& queue, const RuleMatrix& rules) {
+    for (int i = 1; i < queue.size(); i++) {
+        if (!rules.before(queue[i - 1], queue[i])) {
+            return false;
+        }
+    }
 
-                break;
+    return true;
+}
+
+// counts for every page of the queue how many pages of the queue have to be
+// printed after it, returns false if two pages have rules in both directions
+bool countFollowingPages(const PrintQueue& queue, const RuleMatrix& rules, std::vector<int>& following) {
+    following.assign(queue.size(), 0);
+
+    if (rules.dense && rules.conflicts == 0) {
+        // intersect the row of every page with the set of pages in the queue
+        std::vector<std::uint64_t> queueMask(rules.wordsPerRow, 0);
+        for (const int page : queue) {
+            if (page < rules.size)
+                queueMask[page / 64] |= std::uint64_t(1) << (page % 64);
+        }
+
+        for (int i = 0; i < queue.size(); i++) {
+            if (queue[i] >= rules.size)
+                continue;
+
+            const std::uint64_t* row = rules.row(queue[i]);
+            for (int w = 0; w < rules.wordsPerRow; w++) {
+                following[i] += std::popcount(row[w] & queueMask[w]);
             }
         }
 
-        if (swapIndex >= 0) {
-            i = 1;
+        return true;
+    }
+
+    bool consistent = true;
+
+    for (int i = 0; i < queue.size(); i++) {
+        for (int j = i + 1; j < queue.size(); j++) {
+            const bool forward = rules.before(queue[i], queue[j]);
+            const bool backward = rules.before(queue[j], queue[i]);
+
+            consistent &= !(forward && backward);
+            following[i] += forward;
+            following[j] += backward;
+        }
+    }
+
+    return consistent;
+}
+
+// the rules form a total order on the queue iff every pair is ordered in exactly
+// one direction and no two pages have the same number of following pages
+bool isTotalOrder(const std::vector<int>& following) {
+    std::vector<bool> seen(following.size(), false);
+    for (const int count : following) {
+        if (seen[count])
+            return false;
+
+        seen[count] = true;
+    }
+
+    return true;
+}
+
+// Kahn's algorithm for queues whose rules are only a partial order, on a cycle
+// the queue is left unchanged and the cycle is written to diagnostic
+bool topologicalSort(PrintQueue& queue, const RuleMatrix& rules, std::string* diagnostic) {
+    const int n = queue.size();
+    std::vector<int> preceding(n, 0);
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            preceding[j] += i != j && rules.before(queue[i], queue[j]);
+        }
+    }
+
+    std::vector<int> ready;
+    for (int i = n - 1; i >= 0; i--) {
+        if (preceding[i] == 0)
+            ready.push_back(i);
+    }
+
+    PrintQueue sorted;
+    std::vector<bool> placed(n, false);
+    while (!ready.empty()) {
+        int i = ready.back();
+        ready.pop_back();
+
+        sorted.push_back(queue[i]);
+        placed[i] = true;
+
+        for (int j = n - 1; j >= 0; j--) {
+            if (!placed[j] && rules.before(queue[i], queue[j]) && --preceding[j] == 0) {
+                ready.push_back(j);
+            }
+        }
+    }
+
+    if (sorted.size() < n) {
+        if (diagnostic) {
+            // every page left has a preceding page that is left as well, so walking
+            // backwards from any of them has to run into a cycle
+            std::vector<int> visitedAt(n, -1);
+            std::vector<int> path;
+            int current = std::find(placed.begin(), placed.end(), false) - placed.begin();
+
+            while (visitedAt[current] < 0) {
+                visitedAt[current] = path.size();
+                path.push_back(current);
+
+                for (int j = 0; j < n; j++) {
+                    if (!placed[j] && j != current && rules.before(queue[j], queue[current])) {
+                        current = j;
+                        break;
+                    }
+                }
+            }
+
+            // the path was walked against the rules, so it is printed backwards
+            *diagnostic = "cycle in page ordering rules: " + std::to_string(queue[current]);
+            for (int i = path.size() - 1; i >= visitedAt[current]; i--) {
+                *diagnostic += " -> " + std::to_string(queue[path[i]]);
+            }
+        }
+
+        return false;
+    }
+
+    queue = sorted;
+    return true;
+}
+
+// sorts the queue with the rules as comparator if they totally order its pages
+// and topologically otherwise, returns false if the rules contain a cycle
+bool sortQueue(PrintQueue& queue, const RuleMatrix& rules, std::string* diagnostic = nullptr) {
+    std::vector<int> following;
+    if (countFollowingPages(queue, rules, following) && isTotalOrder(following)) {
+        std::sort(queue.begin(), queue.end(), [&rules](int first, int second) {
+            return rules.before(first, second);
+        });
+
+        return true;
+    }
+
+    return topologicalSort(queue, rules, diagnostic);
+}
+
+// the page in the middle of the sorted queue. Under a total order it is the page
+// with as many pages before as after it, so the queue does not have to be sorted
+std::optional<int> findMiddlePage(const PrintQueue& queue, const RuleMatrix& rules, std::string* diagnostic = nullptr) {
+    const int n = queue.size();
+
+    std::vector<int> following;
+    if (countFollowingPages(queue, rules, following) && isTotalOrder(following)) {
+        for (int i = 0; i < n; i++) {
+            if (following[i] == n - 1 - n / 2)
+                return queue[i];
+        }
+    }
+
+    PrintQueue sorted = queue;
+    if (!sortQueue(sorted, rules, diagnostic)) {
+        return std::nullopt;
+    }
+
+    return sorted[n / 2];
+}
+
+// keeps both middle page sums up to date while rules are added and removed, a
+// changed rule only affects the queues that contain both of its pages
+struct IncrementalQueueChecker {
+    RuleMatrix rules;
+    std::vector<PrintQueue> queues;
+    // ascending indices of the queues containing a page
+    std::unordered_map<int, std::vector<int>> queuesByPage;
+
+    std::vector<bool> valid;
+    // middle page of the queue after sorting, empty if the rules contain a cycle
+    std::vector<std::optional<int>> middlePages;
+
+    long long sum = 0;
+    long long sumIncorrect = 0;
+    int unsortableCount = 0;
+
+    IncrementalQueueChecker(const RuleMatrix& rules, const std::vector<PrintQueue>& queues)
+        : rules(rules), queues(queues), valid(queues.size(), false), middlePages(queues.size()) {
+        for (int i = 0; i < queues.size(); i++) {
+            for (const int page : queues[i]) {
+                std::vector<int>& pageQueues = queuesByPage[page];
+                if (pageQueues.empty() || pageQueues.back() != i)
+                    pageQueues.push_back(i);
+            }
+
+            evaluate(i);
+            account(i, 1);
+        }
+    }
+
+    // adds or removes the contribution of a queue to the sums
+    void account(int index, int sign) {
+        if (middlePages[index]) {
+            (valid[index] ? sum : sumIncorrect) += sign * *middlePages[index];
+        }
+        else {
+            unsortableCount += sign;
+        }
+    }
+
+    void evaluate(int index) {
+        const PrintQueue& queue = queues[index];
+        valid[index] = checkQueue(queue, rules);
+        middlePages[index] = valid[index] ? std::optional<int>(queue[queue.size() / 2]) : findMiddlePage(queue, rules);
+    }
+
+    void reevaluate(const std::vector<int>& indices) {
+        for (const int index : indices) {
+            account(index, -1);
+            evaluate(index);
+            account(index, 1);
+        }
+    }
+
+    std::vector<int> affectedQueues(int first, int second) const {
+        auto firstQueues = queuesByPage.find(first);
+        auto secondQueues = queuesByPage.find(second);
+        if (firstQueues == queuesByPage.end() || secondQueues == queuesByPage.end())
+            return {};
+
+        std::vector<int> affected;
+        std::set_intersection(firstQueues->second.begin(), firstQueues->second.end(), secondQueues->second.begin(), secondQueues->second.end(), std::back_inserter(affected));
+
+        return affected;
+    }
+
+    // returns the number of queues that had to be evaluated again
+    int addRule(int first, int second) {
+        if (rules.before(first, second))
+            return 0;
+
+        rules.addRule(first, second);
+
+        std::vector<int> affected = affectedQueues(first, second);
+        reevaluate(affected);
+
+        return affected.size();
+    }
+
+    int removeRule(int first, int second) {
+        if (!rules.removeRule(first, second))
+            return 0;
+
+        std::vector<int> affected = affectedQueues(first, second);
+        reevaluate(affected);
+
+        return affected.size();
+    }
+};
+
+// a random total order of 100 pages with a rule for every pair
+PageOrderingRules generateRules(std::vector<int>& pages, std::mt19937& generator) {
+    pages.resize(100);
+    std::iota(pages.begin(), pages.end(), 0);
+    std::shuffle(pages.begin(), pages.end(), generator);
+
+    PageOrderingRules rules;
+    for (int i = 0; i < pages.size(); i++) {
+        for (int j = i + 1; j < pages.size(); j++) {
+            rules[pages[i]].emplace(pages[j]);
+        }
+    }
+
+    return rules;
+}
+
+std::vector<PrintQueue> generateQueues(const std::vector<int>& pages, int queuesCount, std::mt19937& generator) {
+    std::vector<PrintQueue> queues(queuesCount);
+    for (PrintQueue& queue : queues) {
+        std::uniform_int_distribution<int> length(2, 11);
+        queue.resize(2 * length(generator) + 1);
+
+        std::sample(pages.begin(), pages.end(), queue.begin(), queue.size(), generator);
+        if (generator() % 2)
+            std::shuffle(queue.begin(), queue.end(), generator);
+    }
+
+    return queues;
+}
+
+void benchmark(int queuesCount) {
+    std::mt19937 generator(5);
+    std::vector<int> pages;
+    PageOrderingRules rules = generateRules(pages, generator);
+    RuleMatrix matrix = RuleMatrix::fromRules(rules);
+    std::vector<PrintQueue> queues = generateQueues(pages, queuesCount, generator);
+
+    auto measure = [&](const char* name, auto check) {
+        auto start = std::chrono::steady_clock::now();
+        int valid = 0;
+        for (const PrintQueue& queue : queues) {
+            valid += check(queue);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << name << ": " << elapsed.count() << " s (" << valid << " valid)" << std::endl;
+    };
+
+    measure("std::map rules", [&](const PrintQueue& queue) { return checkQueue(queue, rules); });
+    measure("bit matrix", [&](const PrintQueue& queue) { return checkQueue(queue, matrix); });
+    measure("bit matrix, adjacent pairs", [&](const PrintQueue& queue) { return checkQueueTotalOrder(queue, matrix); });
+}
+
+// replays a churn of rules on 10^6 queues, every change removes a random rule or
+// adds a previously removed one back, and compares against full evaluations
+void replayBenchmark(int changesCount) {
+    std::mt19937 generator(35);
+    std::vector<int> pages;
+    PageOrderingRules rules = generateRules(pages, generator);
+    std::vector<PrintQueue> queues = generateQueues(pages, 1000000, generator);
+
+    auto start = std::chrono::steady_clock::now();
+    IncrementalQueueChecker checker(RuleMatrix::fromRules(rules), queues);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Full evaluation of " << queues.size() << " queues: " << elapsed.count() << " s" << std::endl;
+
+    std::vector<std::pair<int, int>> removed;
+    long long evaluatedCount = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < changesCount; i++) {
+        if (!removed.empty() && generator() % 2) {
+            std::swap(removed[generator() % removed.size()], removed.back());
+            evaluatedCount += checker.addRule(removed.back().first, removed.back().second);
+            removed.pop_back();
         }
         else {
-            i++;
+            const int first = generator() % (pages.size() - 1);
+            const int second = first + 1 + generator() % (pages.size() - first - 1);
+            if (checker.rules.before(pages[first], pages[second])) {
+                evaluatedCount += checker.removeRule(pages[first], pages[second]);
+                removed.emplace_back(pages[first], pages[second]);
+            }
         }
     }
+    elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << changesCount << " rule changes: " << elapsed.count() << " s, " << elapsed.count() / changesCount * 1e3 << " ms per change, "
+              << evaluatedCount / changesCount << " queues evaluated per change" << std::endl;
+
+    start = std::chrono::steady_clock::now();
+    IncrementalQueueChecker fresh(checker.rules, queues);
+    elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Full evaluation after the changes: " << elapsed.count() << " s" << std::endl;
+
+    std::cout << "Incremental sums: " << checker.sum << " " << checker.sumIncorrect << " (" << checker.unsortableCount << " unsortable)" << std::endl;
+    std::cout << "Recomputed sums: " << fresh.sum << " " << fresh.sumIncorrect << " (" << fresh.unsortableCount << " unsortable)" << std::endl;
 }
 
 int main(int argC, char** argV) {
+    bool totalOrder = false;
+    for (int i = 1; i < argC; i++) {
+        std::string_view arg = argV[i];
+        if (arg == "--total-order") {
+            totalOrder = true;
+        }
+        else if (arg.starts_with("--bench=")) {
+            benchmark(std::stoi(std::string(arg.substr(8))));
+            return 0;
+        }
+        else if (arg.starts_with("--replay=")) {
+            replayBenchmark(std::stoi(std::string(arg.substr(9))));
+            return 0;
+        }
+    }
+
     std::fstream file("input.txt");
 
     PageOrderingRules rules = readPageOrderingRules(file);
     std::vector<PrintQueue> queues = readQueues(file);
+    RuleMatrix matrix = RuleMatrix::fromRules(rules);
 
     int sum = 0;
     int sumIncorrect = 0;
     for (int i = 0; i < queues.size(); i++) {
         PrintQueue& queue = queues[i];
 
-        if (checkQueue(queue, rules)) {
+        if (totalOrder ? checkQueueTotalOrder(queue, matrix) : checkQueue(queue, matrix)) {
             int middlePage = queue[queue.size() / 2];
             sum += middlePage;
         }
         else {
-            sortQueue(queue, rules);
-
-            if (!checkQueue(queue, rules)) {
-                throw 1;
+            std::string diagnostic;
+            std::optional<int> middlePage = findMiddlePage(queue, matrix, &diagnostic);
+            if (!middlePage) {
+                std::cerr << "Queue " << i << " cannot be sorted, " << diagnostic << std::endl;
+                continue;
             }
-            int middlePage = queue[queue.size() / 2];
-            sumIncorrect += middlePage;
+
+            sumIncorrect += *middlePage;
         }
     }
 
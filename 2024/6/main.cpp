@@ -1,7 +1,13 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <random>
 #include <string>
-#include <unordered_set>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 struct Vec2 {
@@ -13,19 +19,15 @@ struct Vec2 {
     }
 };
 
-template<>
-struct std::hash<std::pair<Vec2, char>> {
-    std::size_t operator()(const std::pair<Vec2, char>& p) const {
-        return std::hash<long>()((static_cast<long long>(p.first.x) << 40) + (p.first.y << 8) + p.second);
-    }
-};
-
 struct Lab {
     char** lab;
     int labWidth;
     int labHeight;
     Vec2 guardPosition;
-    std::unordered_set<std::pair<Vec2, char>> turns;
+    // turns[(x * labHeight + y) * 4 + direction] == turnsRun if the guard turned
+    // there, incrementing turnsRun forgets all turns at once
+    std::vector<unsigned char> turns;
+    unsigned char turnsRun = 1;
 
     Lab(char** lab, int labWidth, int labHeight, Vec2 guardPosition)
         : lab(lab), labHeight(labHeight), labWidth(labWidth), guardPosition(guardPosition) {
@@ -78,6 +80,23 @@ struct Lab {
         return lab;
     }
 
+    static Lab randomLab(int labWidth, int labHeight, double obstacleDensity, unsigned int seed) {
+        std::mt19937 generator(seed);
+        std::bernoulli_distribution obstacle(obstacleDensity);
+
+        Lab lab = {new char*[labWidth], labWidth, labHeight, {labWidth / 2, labHeight / 2}};
+        for (int x = 0; x < labWidth; x++) {
+            lab.lab[x] = new char[labHeight];
+
+            for (int y = 0; y < labHeight; y++) {
+                lab.lab[x][y] = obstacle(generator) ? '#' : '.';
+            }
+        }
+        lab.lab[lab.guardPosition.x][lab.guardPosition.y] = '^';
+
+        return lab;
+    }
+
     bool isObstacle(int x, int y) const {
         if (x < 0 || y < 0 || x >= labWidth || y >= labHeight) {
             return false;
@@ -90,8 +109,49 @@ struct Lab {
         return !(guardPosition.x < 0 || guardPosition.y < 0 || guardPosition.x >= labWidth || guardPosition.y >= labHeight);
     }
 
+    // copies the grid and guard of a lab with the same size into this one without
+    // allocating, the recorded turns are forgotten
+    void restore(const Lab& other) {
+        for (int x = 0; x < labWidth; x++) {
+            std::copy_n(other.lab[x], labHeight, lab[x]);
+        }
+
+        guardPosition = other.guardPosition;
+        resetTurns();
+    }
+
+    void resetTurns() {
+        if (++turnsRun == 0) {
+            std::fill(turns.begin(), turns.end(), 0);
+            turnsRun = 1;
+        }
+    }
+
     bool addTurn(const Vec2& pos, const char guard) {
-        return turns.emplace(std::make_pair(pos, guard)).second;
+        if (turns.empty()) {
+            turns.resize(labWidth * labHeight * 4, 0);
+        }
+
+        int direction = 0;
+        switch (guard) {
+            case '>':
+                direction = 1;
+                break;
+            case 'v':
+                direction = 2;
+                break;
+            case '<':
+                direction = 3;
+                break;
+        }
+
+        unsigned char& turn = turns[(pos.x * labHeight + pos.y) * 4 + direction];
+        if (turn == turnsRun) {
+            return false;
+        }
+
+        turn = turnsRun;
+        return true;
     }
 
     void moveGuard() {
@@ -203,34 +263,283 @@ struct Lab {
     }
 };
 
-int main(int argC, char** argV) {
-    Lab initialLab = Lab::loadLab("input.txt");
-    Lab lab = Lab(initialLab);
+static constexpr int dx[] = {0, 1, 0, -1};
+static constexpr int dy[] = {-1, 0, 1, 0};
 
-    lab.moveGuard();
+// the cell the guard stops at before the next obstacle for every cell and
+// direction, or -1 if the guard walks out of the lab. Cells are indexed by
+// x * labHeight + y and entries by cell * 4 + direction
+struct JumpTable {
+    int labWidth;
+    int labHeight;
+    std::vector<int> stops;
 
-    int result = lab.countVisitedTiles();
+    JumpTable(const Lab& lab)
+        : labWidth(lab.labWidth), labHeight(lab.labHeight), stops(lab.labWidth * lab.labHeight * 4, -1) {
+        // every direction is filled starting at the wall the guard walks towards
+        for (int x = 0; x < labWidth; x++) {
+            for (int y = 1; y < labHeight; y++) {
+                fill(lab, x, y, 0);
+            }
 
-    std::cout << "Tiles visited: " << result << std::endl;
+            for (int y = labHeight - 2; y >= 0; y--) {
+                fill(lab, x, y, 2);
+            }
+        }
+
+        for (int y = 0; y < labHeight; y++) {
+            for (int x = labWidth - 2; x >= 0; x--) {
+                fill(lab, x, y, 1);
+            }
+
+            for (int x = 1; x < labWidth; x++) {
+                fill(lab, x, y, 3);
+            }
+        }
+    }
+
+    int cell(int x, int y) const {
+        return x * labHeight + y;
+    }
+
+    void fill(const Lab& lab, int x, int y, int direction) {
+        const int nextX = x + dx[direction];
+        const int nextY = y + dy[direction];
+
+        stops[cell(x, y) * 4 + direction] = lab.isObstacle(nextX, nextY) ? cell(x, y) : stops[cell(nextX, nextY) * 4 + direction];
+    }
+
+    int stop(int cell, int direction) const {
+        return stops[cell * 4 + direction];
+    }
+};
+
+// simulates the guard with one additional obstacle laid over the unmodified lab.
+// The guard jumps from turn to turn, only the added obstacle has to be checked on
+// the way. Visited states are stamped with the number of the run, so starting a
+// new run neither copies the lab nor clears any memory
+struct GuardSimulator {
+    const Lab& lab;
+    const JumpTable& jumps;
+    // run that last turned in a cell while facing a direction, indexed like JumpTable::stops
+    std::vector<unsigned int> visited;
+    unsigned int run = 0;
+
+    GuardSimulator(const Lab& lab, const JumpTable& jumps)
+        : lab(lab), jumps(jumps), visited(lab.labWidth * lab.labHeight * 4, 0) {
+    }
+
+    // distance from (x, y) to the obstacle if it lies ahead in the given direction, otherwise -1
+    static int distanceAhead(int x, int y, int direction, const Vec2& obstacle) {
+        const int distanceX = obstacle.x - x;
+        const int distanceY = obstacle.y - y;
+
+        if (dx[direction] == 0) {
+            return distanceX == 0 && distanceY * dy[direction] > 0 ? distanceY * dy[direction] : -1;
+        }
+
+        return distanceY == 0 && distanceX * dx[direction] > 0 ? distanceX * dx[direction] : -1;
+    }
+
+    // returns true if the guard starting at start facing direction never leaves the lab
+    bool isLoop(const Vec2& obstacle, const Vec2& start, int direction) {
+        if (++run == 0) {
+            std::fill(visited.begin(), visited.end(), 0);
+            run = 1;
+        }
+
+        int x = start.x;
+        int y = start.y;
+
+        while (true) {
+            const int stop = jumps.stop(jumps.cell(x, y), direction);
+            const int obstacleDistance = distanceAhead(x, y, direction, obstacle);
+
+            int stopDistance = -1;
+            if (stop >= 0) {
+                stopDistance = std::abs(stop / lab.labHeight - x) + std::abs(stop % lab.labHeight - y);
+            }
+
+            if (obstacleDistance > 0 && (stop < 0 || obstacleDistance <= stopDistance)) {
+                x += (obstacleDistance - 1) * dx[direction];
+                y += (obstacleDistance - 1) * dy[direction];
+            }
+            else if (stop >= 0) {
+                x = stop / lab.labHeight;
+                y = stop % lab.labHeight;
+            }
+            else {
+                return false;
+            }
+
+            unsigned int& state = visited[jumps.cell(x, y) * 4 + direction];
+            if (state == run) {
+                return true;
+            }
+
+            state = run;
+            direction = (direction + 1) % 4;
+        }
+    }
+
+    bool isLoop(const Vec2& obstacle) {
+        return isLoop(obstacle, lab.guardPosition, 0);
+    }
+};
+
+// an obstacle to try and the state the guard is in one step before it would
+// enter the obstacle's cell for the first time
+struct Candidate {
+    Vec2 obstacle;
+    Vec2 start;
+    int direction;
+};
 
-    int closedPathsCount = 0;
-    for (int x = 0; x < initialLab.labWidth; x++) {
-        for (int y = 0; y < initialLab.labHeight; y++) {
-            if (lab.lab[x][y] != 'X' || Vec2{x, y} == initialLab.guardPosition) {
-                continue;
+// walks the guard through the unmodified lab and returns one candidate for every
+// cell on the path except the starting cell. Until the guard first reaches the
+// added obstacle its path is the same, so the simulation can resume right there
+std::vector<Candidate> findCandidates(const Lab& lab) {
+    std::vector<Candidate> candidates;
+    std::vector<bool> seen(lab.labWidth * lab.labHeight, false);
+    std::vector<bool> turned(lab.labWidth * lab.labHeight * 4, false);
+
+    Vec2 position = lab.guardPosition;
+    int direction = 0;
+    seen[position.x * lab.labHeight + position.y] = true;
+
+    while (true) {
+        const Vec2 next = {position.x + dx[direction], position.y + dy[direction]};
+        if (next.x < 0 || next.y < 0 || next.x >= lab.labWidth || next.y >= lab.labHeight) {
+            break;
+        }
+
+        if (lab.isObstacle(next.x, next.y)) {
+            const int state = (position.x * lab.labHeight + position.y) * 4 + direction;
+            if (turned[state]) {
+                break;
             }
 
-            Lab modified = Lab(initialLab);
-            modified.lab[x][y] = '#';
+            turned[state] = true;
+            direction = (direction + 1) % 4;
+            continue;
+        }
+
+        if (!seen[next.x * lab.labHeight + next.y]) {
+            seen[next.x * lab.labHeight + next.y] = true;
+            candidates.push_back({next, position, direction});
+        }
+
+        position = next;
+    }
+
+    return candidates;
+}
+
+// counts the candidate obstacles that trap the guard, the candidates are handed
+// out in blocks to worker threads that each own a simulator with its own buffers
+int countLoops(const Lab& lab, const JumpTable& jumps, const std::vector<Candidate>& candidates, unsigned int threadsCount, bool resume = true) {
+    static constexpr int blockSize = 64;
 
-            modified.moveGuard();
+    std::atomic<int> nextBlock = 0;
+    std::vector<int> loopsCounts(threadsCount, 0);
 
-            bool closedPath = modified.guardInsideLab();
-            if (closedPath) {
-                closedPathsCount++;
+    auto worker = [&](int& loopsCount) {
+        GuardSimulator simulator(lab, jumps);
+        int localCount = 0;
+
+        for (int begin = nextBlock++ * blockSize; begin < candidates.size(); begin = nextBlock++ * blockSize) {
+            const int end = std::min(begin + blockSize, static_cast<int>(candidates.size()));
+            for (int i = begin; i < end; i++) {
+                const Candidate& candidate = candidates[i];
+                localCount += resume ? simulator.isLoop(candidate.obstacle, candidate.start, candidate.direction) : simulator.isLoop(candidate.obstacle);
             }
         }
+
+        loopsCount = localCount;
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < threadsCount; i++) {
+        threads.emplace_back(worker, std::ref(loopsCounts[i]));
+    }
+
+    int loopsCount = 0;
+    for (unsigned int i = 0; i < threadsCount; i++) {
+        threads[i].join();
+        loopsCount += loopsCounts[i];
+    }
+
+    return loopsCount;
+}
+
+// evaluates the candidates on the guard's path through a random lab
+void benchmark(int size) {
+    Lab lab = Lab::randomLab(size, size, 0.005, 6);
+    JumpTable jumps(lab);
+    std::vector<Candidate> candidates = findCandidates(lab);
+
+    auto measure = [&](const std::string& name, unsigned int threadsCount, bool resume) {
+        auto start = std::chrono::steady_clock::now();
+        int loopsCount = countLoops(lab, jumps, candidates, threadsCount, resume);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        std::cout << name << ": " << candidates.size() / elapsed.count() << " candidates/s (" << loopsCount << " of "
+                  << candidates.size() << " candidates close a path)" << std::endl;
+    };
+
+    measure("1 thread, from the start", 1, false);
+
+    // the original evaluation that moves the guard through a modified copy of the
+    // lab, only the time spent in moveGuard is measured
+    std::chrono::duration<double> elapsed(0);
+    const int copiesCount = std::min<int>(candidates.size(), 1000);
+    int loopsCount = 0;
+    Lab modified = Lab(lab);
+    for (int i = 0; i < copiesCount; i++) {
+        modified.restore(lab);
+        modified.lab[candidates[i].obstacle.x][candidates[i].obstacle.y] = '#';
+
+        auto start = std::chrono::steady_clock::now();
+        modified.moveGuard();
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        loopsCount += modified.guardInsideLab();
+    }
+    std::cout << "1 thread, Lab::moveGuard: " << copiesCount / elapsed.count() << " candidates/s (" << loopsCount << " of " << copiesCount
+              << " candidates close a path)" << std::endl;
+
+    const unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threadsCount = 1; threadsCount <= maxThreads; threadsCount *= 2) {
+        measure(std::to_string(threadsCount) + " threads", threadsCount, true);
+    }
+}
+
+int main(int argC, char** argV) {
+    unsigned int threadsCount = 1;
+    for (int i = 1; i < argC; i++) {
+        std::string_view arg = argV[i];
+        if (arg.starts_with("--threads=")) {
+            threadsCount = std::max(1, std::stoi(std::string(arg.substr(10))));
+        }
+        else if (arg.starts_with("--bench=")) {
+            benchmark(std::stoi(std::string(arg.substr(8))));
+            return 0;
+        }
     }
 
+    Lab initialLab = Lab::loadLab("input.txt");
+    Lab lab = Lab(initialLab);
+
+    lab.moveGuard();
+
+    int result = lab.countVisitedTiles();
+
+    std::cout << "Tiles visited: " << result << std::endl;
+
+    std::vector<Candidate> candidates = findCandidates(initialLab);
+
+    JumpTable jumps(initialLab);
+    int closedPathsCount = countLoops(initialLab, jumps, candidates, threadsCount);
+
     std::cout << "Closed paths: " << closedPathsCount << std::endl;
 }
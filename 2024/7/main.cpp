@@ -1,7 +1,16 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <numeric>
 #include <optional>
+#include <random>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
 struct Equation {
@@ -37,73 +46,429 @@ struct Equation {
         return eqn;
     }
 
-    NumberType getResult() const {
-        NumberType result = terms[0];
-        for (int i = 1; i < terms.size(); i++) {
-            switch (operators[i - 1]) {
-                case '+':
-                    result += terms[i];
-                    break;
-                case '*':
-                    result *= terms[i];
-                    break;
-                case '|': {
-                    int factor = 10;
-                    while(factor <= terms[i]) {
-                        factor *= 10;
-                    }
-
-                    result = result * factor + terms[i];
-                } break;
-                default:
-                    break;
+    bool determineOperators();
+};
+
+using Wide = __int128;
+
+std::optional<Wide> checkedAdd(Wide first, Wide second) {
+    Wide result;
+    if (__builtin_add_overflow(first, second, &result))
+        return std::nullopt;
+
+    return result;
+}
+
+std::optional<Wide> checkedSubtract(Wide first, Wide second) {
+    Wide result;
+    if (__builtin_sub_overflow(first, second, &result))
+        return std::nullopt;
+
+    return result;
+}
+
+std::optional<Wide> checkedMultiply(Wide first, Wide second) {
+    Wide result;
+    if (__builtin_mul_overflow(first, second, &result))
+        return std::nullopt;
+
+    return result;
+}
+
+struct WideHash {
+    std::size_t operator()(Wide value) const {
+        unsigned long long low = value;
+        unsigned long long high = value >> 64;
+        return std::hash<unsigned long long>()(low ^ (high * 0x9e3779b97f4a7c15ull));
+    }
+};
+
+// smallest power of ten greater than value
+std::optional<Wide> decimalShift(Wide value) {
+    Wide factor = 10;
+    while (factor <= value) {
+        if (__builtin_mul_overflow(factor, 10, &factor))
+            return std::nullopt;
+    }
+
+    return factor;
+}
+
+// Every operator supplies apply for the forward direction, feasible and invert to
+// undo it from a known result. feasible is a cheap necessary condition, invert
+// returns the unique left operand or nothing. monotone operators never make a
+// value smaller if all terms are positive, which allows cutting off values
+// that have already grown past the result. nonNegative operators never turn
+// non-negative operands into a negative value, the terms never are negative
+struct Add {
+    static constexpr char symbol = '+';
+    static constexpr bool monotone = true;
+    static constexpr bool invertible = true;
+    static constexpr bool nonNegative = true;
+
+    static std::optional<Wide> apply(Wide value, Wide term) {
+        return checkedAdd(value, term);
+    }
+
+    static bool feasible(Wide target, Wide term, bool nonNegative) {
+        return !nonNegative || target >= term;
+    }
+
+    static std::optional<Wide> invert(Wide target, Wide term) {
+        return checkedSubtract(target, term);
+    }
+};
+
+struct Multiply {
+    static constexpr char symbol = '*';
+    static constexpr bool monotone = true;
+    static constexpr bool invertible = true;
+    static constexpr bool nonNegative = true;
+
+    static std::optional<Wide> apply(Wide value, Wide term) {
+        return checkedMultiply(value, term);
+    }
+
+    static bool feasible(Wide target, Wide term, bool) {
+        return term == 0 ? target == 0 : target % term == 0;
+    }
+
+    // everything in front of a factor 0 is irrelevant
+    static bool absorbs(Wide target, Wide term) {
+        return term == 0 && target == 0;
+    }
+
+    static std::optional<Wide> invert(Wide target, Wide term) {
+        return target / term;
+    }
+};
+
+struct Concatenate {
+    static constexpr char symbol = '|';
+    static constexpr bool monotone = true;
+    static constexpr bool invertible = true;
+    static constexpr bool nonNegative = true;
+
+    // only defined for non-negative values, like feasible and invert
+    static std::optional<Wide> apply(Wide value, Wide term) {
+        std::optional<Wide> factor = decimalShift(term);
+        if (!factor || term < 0 || value < 0)
+            return std::nullopt;
+
+        std::optional<Wide> shifted = checkedMultiply(value, *factor);
+        return shifted ? checkedAdd(*shifted, term) : std::nullopt;
+    }
+
+    static bool feasible(Wide target, Wide term, bool) {
+        std::optional<Wide> factor = decimalShift(term);
+        return factor && term >= 0 && target >= 0 && target % *factor == term;
+    }
+
+    static std::optional<Wide> invert(Wide target, Wide term) {
+        return target / *decimalShift(term);
+    }
+};
+
+struct Subtract {
+    static constexpr char symbol = '-';
+    static constexpr bool monotone = false;
+    static constexpr bool invertible = true;
+    static constexpr bool nonNegative = false;
+
+    static std::optional<Wide> apply(Wide value, Wide term) {
+        return checkedSubtract(value, term);
+    }
+
+    static bool feasible(Wide, Wide, bool) {
+        return true;
+    }
+
+    static std::optional<Wide> invert(Wide target, Wide term) {
+        return checkedAdd(target, term);
+    }
+};
+
+// the left operand of a modulo is not unique, so sets containing it are solved forwards
+struct Modulo {
+    static constexpr char symbol = '%';
+    static constexpr bool monotone = false;
+    static constexpr bool invertible = false;
+    static constexpr bool nonNegative = true;
+
+    static std::optional<Wide> apply(Wide value, Wide term) {
+        if (term == 0)
+            return std::nullopt;
+
+        return value % term;
+    }
+
+    static bool feasible(Wide target, Wide term, bool) {
+        return term != 0 && (target < 0 ? -target : target) < (term < 0 ? -term : term);
+    }
+
+    static std::optional<Wide> invert(Wide, Wide) {
+        return std::nullopt;
+    }
+};
+
+template<typename... Operators>
+struct OperatorSet {
+    static constexpr bool monotone = (Operators::monotone && ...);
+    static constexpr bool invertible = (Operators::invertible && ...);
+    // all values stay non-negative, the terms are unsigned
+    static constexpr bool nonNegative = (Operators::nonNegative && ...);
+
+    static bool solve(Equation& eqn) {
+        eqn.operators = std::vector<char>(eqn.terms.size() - 1, '+');
+
+        // values never shrink below the first term if every operator is monotone and all terms are positive
+        bool positiveTerms = std::all_of(eqn.terms.begin(), eqn.terms.end(), [](Equation::NumberType term) { return term > 0; });
+        const bool cutoff = monotone && positiveTerms;
+
+        bool solved;
+        if constexpr (invertible) {
+            solved = solveBackwards(eqn, eqn.terms.size() - 1, eqn.result, cutoff);
+        }
+        else {
+            solved = searchForwards(eqn, cutoff);
+        }
+
+        // like the counter, which wraps around to all '+' once it has tried everything
+        if (!solved) {
+            eqn.operators.assign(eqn.operators.size(), '+');
+        }
+
+        return solved;
+    }
+
+    static bool solveBackwards(Equation& eqn, int index, Wide target, bool cutoff) {
+        if (index == 0) {
+            return target == eqn.terms[0];
+        }
+
+        if (cutoff && target < eqn.terms[0]) {
+            return false;
+        }
+
+        return (undo<Operators>(eqn, index, target, cutoff) || ...);
+    }
+
+    template<typename Operator>
+    static bool undo(Equation& eqn, int index, Wide target, bool cutoff) {
+        const Wide term = eqn.terms[index];
+        if (!Operator::feasible(target, term, nonNegative))
+            return false;
+
+        // the terms in front can be combined in any way, the first operator of the set is used for them
+        if constexpr (requires { Operator::absorbs(target, term); }) {
+            if (Operator::absorbs(target, term)) {
+                static constexpr char symbols[] = {Operators::symbol...};
+                std::fill(eqn.operators.begin(), eqn.operators.begin() + index - 1, symbols[0]);
+                eqn.operators[index - 1] = Operator::symbol;
+                return true;
             }
         }
 
-        return result;
+        std::optional<Wide> previous = Operator::invert(target, term);
+        if (!previous)
+            return false;
+
+        eqn.operators[index - 1] = Operator::symbol;
+        return solveBackwards(eqn, index - 1, *previous, cutoff);
+    }
+
+    template<typename Operator>
+    static bool applyIf(char symbol, Wide& value, Wide term) {
+        if (symbol != Operator::symbol)
+            return false;
+
+        std::optional<Wide> next = Operator::apply(value, term);
+        if (!next)
+            return false;
+
+        value = *next;
+        return true;
+    }
+
+    // evaluates the operators from the left, stops at an overflow or once a monotone value exceeds the result
+    static bool evaluate(const Equation& eqn, bool cutoff) {
+        Wide value = eqn.terms[0];
+        for (int i = 1; i < eqn.terms.size(); i++) {
+            if (!(applyIf<Operators>(eqn.operators[i - 1], value, eqn.terms[i]) || ...))
+                return false;
+
+            if (cutoff && value > eqn.result)
+                return false;
+        }
+
+        return value == eqn.result;
     }
 
-    bool isValid() const {
-        return result == getResult();
+    // values already reached at each depth, a value that comes up again has failed before
+    using Visited = std::vector<std::unordered_set<Wide, WideHash>>;
+
+    static bool searchForwards(Equation& eqn, bool cutoff) {
+        eqn.operators = std::vector<char>(eqn.terms.size() - 1, '+');
+
+        Visited visited(eqn.terms.size());
+        return searchForwards(eqn, 1, eqn.terms[0], cutoff, visited);
     }
 
-    bool determineOperators() {
-        operators = std::vector<char>(terms.size() - 1, '+');
+    // carries the value of the prefix down, so every prefix is only computed once
+    static bool searchForwards(Equation& eqn, int index, Wide value, bool cutoff, Visited& visited) {
+        if (index == eqn.terms.size()) {
+            return value == eqn.result;
+        }
+
+        if (cutoff && value > eqn.result) {
+            return false;
+        }
+
+        if (!visited[index].insert(value).second) {
+            return false;
+        }
+
+        return (extend<Operators>(eqn, index, value, cutoff, visited) || ...);
+    }
+
+    template<typename Operator>
+    static bool extend(Equation& eqn, int index, Wide value, bool cutoff, Visited& visited) {
+        std::optional<Wide> next = Operator::apply(value, eqn.terms[index]);
+        if (!next)
+            return false;
+
+        eqn.operators[index - 1] = Operator::symbol;
+        return searchForwards(eqn, index + 1, *next, cutoff, visited);
+    }
+
+    // counts through all operator combinations like a base sizeof...(Operators) number, the baseline for --bench
+    static bool enumerate(Equation& eqn, bool cutoff) {
+        static constexpr char symbols[] = {Operators::symbol...};
+        std::vector<int> digits(eqn.operators.size(), 0);
+
+        while (true) {
+            for (int i = 0; i < digits.size(); i++) {
+                eqn.operators[i] = symbols[digits[i]];
+            }
+
+            if (evaluate(eqn, cutoff))
+                return true;
 
-        bool eqnValid = isValid();
-        bool end = false;
-        while (!eqnValid && !end) {
-            // update operators
-            bool carry = false;
             int index = 0;
+            while (index < digits.size() && ++digits[index] == sizeof...(Operators)) {
+                digits[index++] = 0;
+            }
+
+            if (index == digits.size())
+                return false;
+        }
+    }
+
+    // random equations from this set, roughly half of them get a result that is off by one
+    static std::vector<Equation> generate(int count, unsigned int seed) {
+        static constexpr char symbols[] = {Operators::symbol...};
+        std::mt19937 generator(seed);
+        std::uniform_int_distribution<int> lengthDistribution(4, 9);
+        std::uniform_int_distribution<int> termDistribution(0, 99);
+        std::uniform_int_distribution<int> operatorDistribution(0, sizeof...(Operators) - 1);
+
+        std::vector<Equation> equations;
+        while (equations.size() < count) {
+            Equation eqn;
+            eqn.terms.resize(lengthDistribution(generator));
+            for (auto& term : eqn.terms) {
+                term = termDistribution(generator);
+            }
 
-            do {
-                switch (operators[index]) {
-                    case '+':
-                        carry = false;
-                        operators[index] = '*';
-                        break;
-                    case '*':
-                        carry = false;
-                        operators[index] = '|';
-                        break;
-                    case '|':
-                        carry = true;
-                        operators[index] = '+';
-                        break;
-                }
+            Wide value = eqn.terms[0];
+            bool valid = true;
+            for (int i = 1; i < eqn.terms.size() && valid; i++) {
+                char symbol = symbols[operatorDistribution(generator)];
+                valid = (applyIf<Operators>(symbol, value, eqn.terms[i]) || ...);
+            }
 
-                index++;
-            } while (carry && index < operators.size());
+            if (!valid || value <= 0 || value >= std::numeric_limits<Equation::NumberType>::max())
+                continue;
 
-            end = carry;
-            eqnValid = isValid();
+            eqn.result = value + (generator() & 1);
+            equations.push_back(eqn);
         }
 
-        return eqnValid;
+        return equations;
+    }
+
+    // times the counter enumeration against the forward search and, if the set has one, the
+    // backward search. Afterwards every verdict is compared with the one of the counter and
+    // every operator assignment found is evaluated again
+    static void benchmark(int count) {
+        const std::vector<Equation> equations = generate(count, 7);
+        std::vector<char> expected;
+
+        auto time = [&equations, &expected](const char* name, auto method) {
+            std::vector<Equation> copies = equations;
+            std::vector<char> verdicts(copies.size());
+
+            auto start = std::chrono::steady_clock::now();
+            int validCount = 0;
+            for (int i = 0; i < copies.size(); i++) {
+                Equation& eqn = copies[i];
+                eqn.operators = std::vector<char>(eqn.terms.size() - 1, '+');
+
+                bool positiveTerms = std::all_of(eqn.terms.begin(), eqn.terms.end(), [](Equation::NumberType term) { return term > 0; });
+                verdicts[i] = method(eqn, monotone && positiveTerms);
+                validCount += verdicts[i];
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            if (expected.empty()) {
+                expected = verdicts;
+            }
+
+            int disagreements = 0, wrongOperators = 0;
+            for (int i = 0; i < copies.size(); i++) {
+                disagreements += verdicts[i] != expected[i];
+                wrongOperators += verdicts[i] && !evaluate(copies[i], false);
+            }
+
+            std::cout << name << ": " << validCount << " valid in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms";
+            std::cout << ", " << disagreements << " disagreements, " << wrongOperators << " wrong operators" << std::endl;
+        };
+
+        time("counter enumeration", [](Equation& eqn, bool cutoff) { return enumerate(eqn, cutoff); });
+        time("forward search", [](Equation& eqn, bool cutoff) { return searchForwards(eqn, cutoff); });
+        if constexpr (invertible) {
+            time("backward search", [](Equation& eqn, bool cutoff) { return solveBackwards(eqn, eqn.terms.size() - 1, eqn.result, cutoff); });
+        }
     }
 };
 
+using Solver = bool (*)(Equation&);
+
+struct OperatorSetEntry {
+    std::string_view name;
+    Solver solver;
+    void (*benchmark)(int count);
+};
+
+template<typename... Operators>
+constexpr OperatorSetEntry makeEntry(std::string_view name) {
+    return {name, OperatorSet<Operators...>::solve, OperatorSet<Operators...>::benchmark};
+}
+
+static const OperatorSetEntry operatorSets[] = {
+    makeEntry<Add, Multiply>("+*"),
+    makeEntry<Add, Multiply, Concatenate>("+*|"),
+    makeEntry<Add, Subtract, Multiply>("+-*"),
+    makeEntry<Add, Subtract, Multiply, Concatenate>("+-*|"),
+    makeEntry<Add, Multiply, Modulo>("+*%"),
+    makeEntry<Add, Multiply, Concatenate, Modulo>("+*|%"),
+    makeEntry<Add, Subtract, Multiply, Concatenate, Modulo>("+-*|%"),
+};
+
+bool Equation::determineOperators() {
+    return OperatorSet<Add, Multiply, Concatenate>::solve(*this);
+}
+
 std::ostream& operator<<(std::ostream& str, const Equation& eqn) {
     str << eqn.result << " = " << eqn.terms[0];
 
@@ -114,7 +479,81 @@ std::ostream& operator<<(std::ostream& str, const Equation& eqn) {
     return str;
 }
 
+// solves all equations on threadsCount threads and returns the sum of the valid
+// results. The equations are handed out longest first to balance the load, the
+// validity of each one is written to valid at its input index
+unsigned long long solveParallel(std::vector<Equation>& equations, std::vector<bool>& valid, unsigned int threadsCount, Solver solver) {
+    std::vector<int> order(equations.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&equations](int first, int second) {
+        return equations[first].terms.size() > equations[second].terms.size();
+    });
+
+    // std::vector<bool> packs bits, so every thread writes to its own bytes first
+    std::vector<char> results(equations.size(), false);
+    std::vector<unsigned long long> sums(threadsCount, 0);
+    std::atomic<int> next = 0;
+
+    auto worker = [&](unsigned long long& sum) {
+        unsigned long long localSum = 0;
+        for (int i = next++; i < order.size(); i = next++) {
+            Equation& equation = equations[order[i]];
+            if (solver(equation)) {
+                results[order[i]] = true;
+                localSum += equation.result;
+            }
+        }
+
+        sum = localSum;
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < threadsCount; i++) {
+        threads.emplace_back(worker, std::ref(sums[i]));
+    }
+
+    unsigned long long totalResult = 0;
+    for (unsigned int i = 0; i < threadsCount; i++) {
+        threads[i].join();
+        totalResult += sums[i];
+    }
+
+    valid.assign(results.begin(), results.end());
+    return totalResult;
+}
+
 int main(int argC, char** argV) {
+    unsigned int threadsCount = 0;
+    int benchCount = 0;
+    const OperatorSetEntry* operatorSet = &operatorSets[1];
+    Solver solver = [](Equation& equation) { return equation.determineOperators(); };
+    for (int i = 1; i < argC; i++) {
+        std::string_view arg = argV[i];
+        if (arg.starts_with("--threads=")) {
+            threadsCount = std::stoi(std::string(arg.substr(10)));
+        }
+        else if (arg.starts_with("--bench=")) {
+            benchCount = std::stoi(std::string(arg.substr(8)));
+        }
+        else if (arg.starts_with("--operators=")) {
+            operatorSet = std::find_if(std::begin(operatorSets), std::end(operatorSets), [&arg](const auto& entry) {
+                return entry.name == arg.substr(12);
+            });
+
+            if (operatorSet == std::end(operatorSets)) {
+                std::cerr << "Unknown operator set " << arg.substr(12) << std::endl;
+                return 1;
+            }
+
+            solver = operatorSet->solver;
+        }
+    }
+
+    if (benchCount > 0) {
+        operatorSet->benchmark(benchCount);
+        return 0;
+    }
+
     std::ifstream file("input.txt");
 
     std::vector<Equation> equations;
@@ -124,9 +563,22 @@ int main(int argC, char** argV) {
         equations.push_back(Equation::parse(line));
     }
 
+    if (threadsCount > 0) {
+        std::vector<bool> valid;
+        unsigned long long int totalResult = solveParallel(equations, valid, threadsCount, solver);
+
+        // printed after all threads are done so the order matches the input
+        for (int i = 0; i < equations.size(); i++) {
+            std::cout << equations[i] << (valid[i] ? " valid\r\n" : " not valid\r\n");
+        }
+
+        std::cout << "Total calibration value: " << totalResult << std::endl;
+        return 0;
+    }
+
     unsigned long long int totalResult = 0;
     for (auto& equation : equations) {
-        if (equation.determineOperators()) {
+        if (solver(equation)) {
             totalResult += equation.result;
             std::cout << equation << " valid\r\n";
         }
@@ -1,8 +1,14 @@
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <numeric>
 #include <set>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 struct Vec2 {
@@ -47,6 +53,53 @@ Vec2 operator*(const int& scal, const Vec2& vec) {
     return Vec2(scal * vec.x, scal * vec.y);
 }
 
+// smallest step between the lattice points on the line through a pair
+Vec2 lineStep(const Vec2& difference) {
+    const int divisor = std::gcd(difference.x, difference.y);
+    return Vec2(difference.x / divisor, difference.y / divisor);
+}
+
+// one bit per cell, row after row
+struct AntinodeGrid {
+    int width = 0, height = 0;
+    std::vector<uint64_t> words;
+
+    AntinodeGrid(int width = 0, int height = 0)
+        : width(width), height(height), words((static_cast<size_t>(width) * height + 63) / 64, 0) {
+    }
+
+    bool contains(const Vec2& pos) const {
+        return pos.x >= 0 && pos.x < width && pos.y >= 0 && pos.y < height;
+    }
+
+    void set(const Vec2& pos) {
+        const size_t index = static_cast<size_t>(pos.y) * width + pos.x;
+        words[index / 64] |= uint64_t(1) << (index % 64);
+    }
+
+    bool test(const Vec2& pos) const {
+        const size_t index = static_cast<size_t>(pos.y) * width + pos.x;
+        return words[index / 64] >> (index % 64) & 1;
+    }
+
+    size_t count() const {
+        size_t result = 0;
+        for (uint64_t word : words) {
+            result += __builtin_popcountll(word);
+        }
+
+        return result;
+    }
+
+    AntinodeGrid& operator|=(const AntinodeGrid& other) {
+        for (size_t i = 0; i < words.size(); i++) {
+            words[i] |= other.words[i];
+        }
+
+        return *this;
+    }
+};
+
 struct Map;
 
 std::ostream& operator<<(std::ostream&, const Map&);
@@ -93,39 +146,194 @@ struct Map {
         outputFile.close();
     }
 
-    std::set<Vec2> getAntinodePositions() const {
+    // wholeLine selects part 2, otherwise only the two points mirrored across each pair count
+    std::set<Vec2> getAntinodePositions(bool wholeLine = true) const {
         std::set<Vec2> antinodePositions;
 
         for (const auto& [freq, positions] : antennaPositions) {
             // loop through pairs
             for (auto it = positions.begin(); it != positions.end(); it++) {
                 for (auto jt = positions.upper_bound(*it); jt != positions.end(); jt++) {
-                    Vec2 difference = *it - *jt;
+                    if (!wholeLine) {
+                        for (Vec2 antinode : {*it + (*it - *jt), *jt - (*it - *jt)}) {
+                            if (antinode.x >= 0 && antinode.x < width && antinode.y >= 0 && antinode.y < height) {
+                                antinodePositions.insert(antinode);
+                            }
+                        }
+
+                        continue;
+                    }
+
+                    Vec2 step = lineStep(*it - *jt);
 
                     Vec2 antinode1 = *it;
                     while (antinode1.x >= 0 && antinode1.x < width && antinode1.y >= 0 && antinode1.y < height) {
                         antinodePositions.insert(antinode1);
-                        if (map[antinode1.x][antinode1.y] == '.') {
-                            map[antinode1.x][antinode1.y] = '#';
-                        }
-
-                        antinode1 += difference;
+                        antinode1 += step;
                     }
 
-                    Vec2 antinode2 = *jt;
+                    Vec2 antinode2 = *it - step;
                     while (antinode2.x >= 0 && antinode2.x < width && antinode2.y >= 0 && antinode2.y < height) {
                         antinodePositions.insert(antinode2);
-                        if (map[antinode2.x][antinode2.y] == '.') {
-                            map[antinode2.x][antinode2.y] = '#';
+                        antinode2 -= step;
+                    }
+                }
+            }
+        }
+
+        return antinodePositions;
+    }
+
+    // marks the antinodes of a single frequency, every lattice point on the line through
+    // a pair for part 2 or the two points mirrored across it for part 1
+    void markAntinodes(const std::set<Vec2>& positions, AntinodeGrid& grid, bool wholeLine) const {
+        for (auto it = positions.begin(); it != positions.end(); it++) {
+            for (auto jt = std::next(it); jt != positions.end(); jt++) {
+                if (!wholeLine) {
+                    for (Vec2 antinode : {*it + (*it - *jt), *jt - (*it - *jt)}) {
+                        if (grid.contains(antinode)) {
+                            grid.set(antinode);
+                        }
+                    }
+
+                    continue;
+                }
+
+                Vec2 step = lineStep(*it - *jt);
+
+                for (Vec2 antinode = *it; grid.contains(antinode); antinode += step) {
+                    grid.set(antinode);
+                }
+
+                for (Vec2 antinode = *it - step; grid.contains(antinode); antinode -= step) {
+                    grid.set(antinode);
+                }
+            }
+        }
+    }
+
+    // every frequency is marked on its own thread into a private grid, the grids are merged afterwards
+    AntinodeGrid getAntinodeGrid(bool wholeLine = true) const {
+        std::vector<AntinodeGrid> grids(antennaPositions.size(), AntinodeGrid(width, height));
+
+        std::vector<std::thread> threads;
+        int index = 0;
+        for (const auto& [freq, positions] : antennaPositions) {
+            threads.emplace_back([this, &positions, &grid = grids[index++], wholeLine]() {
+                markAntinodes(positions, grid, wholeLine);
+            });
+        }
+
+        AntinodeGrid result(width, height);
+        for (int i = 0; i < threads.size(); i++) {
+            threads[i].join();
+            result |= grids[i];
+        }
+
+        return result;
+    }
+
+    // draws the antinodes onto all empty cells
+    void render(const AntinodeGrid& antinodes) {
+        for (int x = 0; x < width; x++) {
+            for (int y = 0; y < height; y++) {
+                if (map[x][y] == '.' && antinodes.test(Vec2(x, y))) {
+                    map[x][y] = '#';
+                }
+            }
+        }
+    }
+};
+
+// antenna coordinates without the grid, for maps that are too large to hold in memory
+struct SparseMap {
+    std::map<char, std::vector<Vec2>> antennaPositions;
+
+    int width = 0, height = 0;
+
+    // reads either a character map line by line or a coordinate list, which starts
+    // with a "width height" line followed by one "frequency x y" line per antenna
+    static SparseMap load(const std::string& filename) {
+        std::ifstream file(filename);
+        std::string line;
+
+        SparseMap result;
+        if (!std::getline(file, line))
+            return result;
+
+        if (line.find(' ') != std::string::npos) {
+            std::istringstream(line) >> result.width >> result.height;
+
+            char freq;
+            Vec2 pos;
+            while (file >> freq >> pos.x >> pos.y) {
+                result.antennaPositions[freq].push_back(pos);
+            }
+
+            return result;
+        }
+
+        result.width = line.size();
+        do {
+            for (int x = 0; x < line.size(); x++) {
+                if (line[x] != '.') {
+                    result.antennaPositions[line[x]].push_back(Vec2(x, result.height));
+                }
+            }
+
+            result.height++;
+        } while (std::getline(file, line) && !line.empty());
+
+        return result;
+    }
+
+    bool contains(const Vec2& pos) const {
+        return pos.x >= 0 && pos.x < width && pos.y >= 0 && pos.y < height;
+    }
+
+    static uint64_t packKey(const Vec2& pos) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(pos.x)) << 32 | static_cast<uint32_t>(pos.y);
+    }
+
+    // part 1 only takes the two points mirrored across each pair, part 2 every
+    // lattice point on the line through the pair
+    size_t countAntinodes(bool wholeLine) const {
+        std::vector<uint64_t> keys;
+
+        for (const auto& [freq, positions] : antennaPositions) {
+            for (int i = 0; i < positions.size(); i++) {
+                for (int j = i + 1; j < positions.size(); j++) {
+                    Vec2 difference = positions[i] - positions[j];
+
+                    // a coordinate list can name the same antenna twice, which spans no line
+                    if (difference.x == 0 && difference.y == 0)
+                        continue;
+
+                    if (!wholeLine) {
+                        for (Vec2 antinode : {positions[i] + difference, positions[j] - difference}) {
+                            if (contains(antinode)) {
+                                keys.push_back(packKey(antinode));
+                            }
                         }
 
-                        antinode2 -= difference;
+                        continue;
+                    }
+
+                    const Vec2 step = lineStep(difference);
+
+                    for (Vec2 antinode = positions[i]; contains(antinode); antinode += step) {
+                        keys.push_back(packKey(antinode));
+                    }
+
+                    for (Vec2 antinode = positions[i] - step; contains(antinode); antinode -= step) {
+                        keys.push_back(packKey(antinode));
                     }
                 }
             }
         }
 
-        return antinodePositions;
+        std::sort(keys.begin(), keys.end());
+        return std::unique(keys.begin(), keys.end()) - keys.begin();
     }
 };
 
@@ -141,10 +349,53 @@ std::ostream& operator<<(std::ostream& os, const Map& map) {
 }
 
 int main(int argC, char** argV) {
+    bool render = false;
+    bool useSet = false;
+    bool sparse = false;
+    int part = 2;
+    for (int i = 1; i < argC; i++) {
+        std::string_view arg = argV[i];
+        if (arg == "--render") {
+            render = true;
+        }
+        else if (arg == "--set") {
+            useSet = true;
+        }
+        else if (arg == "--sparse") {
+            sparse = true;
+        }
+        else if (arg.starts_with("--part=")) {
+            part = std::stoi(std::string(arg.substr(7)));
+
+            if (part != 1 && part != 2) {
+                std::cerr << "Unknown part " << part << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    if (sparse) {
+        SparseMap map = SparseMap::load("input.txt");
+
+        std::cout << "Antinodes count: " << map.countAntinodes(part == 2) << std::endl;
+        return 0;
+    }
+
     Map map = Map::loadMap("input.txt");
 
-    std::set<Vec2> antinodePositions = map.getAntinodePositions();
+    if (useSet) {
+        std::set<Vec2> antinodePositions = map.getAntinodePositions(part == 2);
+
+        std::cout << "Antinodes count: " << antinodePositions.size() << std::endl;
+        return 0;
+    }
+
+    AntinodeGrid antinodes = map.getAntinodeGrid(part == 2);
+
+    if (render) {
+        map.render(antinodes);
+        std::cout << map << std::endl;
+    }
 
-    std::cout << map << std::endl;
-    std::cout << "Antinodes count: " << antinodePositions.size() << std::endl;
+    std::cout << "Antinodes count: " << antinodes.count() << std::endl;
 }
\ No newline at end of file
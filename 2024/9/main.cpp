@@ -1,153 +1,309 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <queue>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// a run of blocks that all belong to the same file, or to no file if fileId is -1
+struct DiskSpan {
+    // the start comes first so a span packs into 16 bytes
+    uint64_t start;
+    int32_t fileId;
+    int32_t length;
+
+    DiskSpan(int32_t fileId, uint64_t start, int32_t length)
+        : start(start), fileId(fileId), length(length) {
+    }
+
+    // sum of index * fileId over all blocks of the span, wraps around past 64 bits
+    uint64_t checksum() const {
+        if (fileId < 0 || length <= 0)
+            return 0;
+
+        const uint64_t len = length;
+        return fileId * (start * len + len * (len - 1) / 2);
+    }
+};
+
 struct FileSystem {
-    unsigned int totalBlocks = 0;
-    std::vector<int> blocks;
+    uint64_t totalBlocks = 0;
 
-    FileSystem(const std::vector<int>& diskMap) {
-        for (auto it = diskMap.begin(); it != diskMap.end(); it++) {
-            totalBlocks += *it;
-        }
+    // the spans of all files indexed by their id, and all free spans from left to right
+    std::vector<DiskSpan> files;
+    std::vector<DiskSpan> freeSpans;
+
+    FileSystem(const std::vector<uint8_t>& diskMap) {
+        files.reserve(diskMap.size() / 2 + 1);
+        freeSpans.reserve(diskMap.size() / 2);
 
-        blocks.reserve(totalBlocks);
         bool file = true;
-        short fileId = 0;
-        unsigned int offset = 0;
+        int32_t fileId = 0;
 
         for (auto it = diskMap.begin(); it != diskMap.end(); it++) {
             int blocksCount = *it;
 
             if (file) {
-                for (int i = 0; i < blocksCount; i++) {
-                    blocks.emplace_back(fileId);
-                }
-
+                files.push_back({fileId, totalBlocks, blocksCount});
                 fileId++;
             }
-            else {
-                for (int i = 0; i < blocksCount; i++) {
-                    blocks.emplace_back(-1);
-                }
+            else if (blocksCount > 0) {
+                freeSpans.push_back({-1, totalBlocks, blocksCount});
             }
 
             file = !file;
 
-            offset += blocksCount;
+            totalBlocks += blocksCount;
         }
     }
 
-    int getFirstFreeBlock(int startIndex = 0) const {
-        int index = startIndex;
-        while (index < totalBlocks && blocks[index] != -1) {
-            index++;
+    // moves single blocks from the end of the disk into the leftmost free block and
+    // returns the checksum of the result. One pointer walks the spans from the left,
+    // the other takes blocks off the last file, so the moved blocks are only summed up
+    uint64_t compressBlocks() const {
+        uint64_t checksum = 0;
+        if (files.empty())
+            return checksum;
+
+        int lastFile = files.size() - 1;
+        int lastFileRemaining = files[lastFile].length;
+        int freeIndex = 0;
+
+        for (int fileID = 0; fileID < lastFile; fileID++) {
+            checksum += files[fileID].checksum();
+
+            const uint64_t nextFileStart = files[fileID + 1].start;
+            for (; freeIndex < freeSpans.size() && freeSpans[freeIndex].start < nextFileStart; freeIndex++) {
+                uint64_t freeBlock = freeSpans[freeIndex].start;
+                int freeLength = freeSpans[freeIndex].length;
+
+                while (freeLength > 0 && lastFile > fileID) {
+                    // the file at the left pointer has already been summed up
+                    if (lastFileRemaining <= 0) {
+                        lastFile--;
+                        lastFileRemaining = lastFile > fileID ? files[lastFile].length : 0;
+                        continue;
+                    }
+
+                    int moved = std::min(freeLength, lastFileRemaining);
+                    checksum += DiskSpan{lastFile, freeBlock, moved}.checksum();
+
+                    freeBlock += moved;
+                    freeLength -= moved;
+                    lastFileRemaining -= moved;
+                }
+            }
         }
 
-        return index;
+        // whatever is left of the last file stays at its start
+        if (lastFileRemaining > 0) {
+            checksum += DiskSpan{lastFile, files[lastFile].start, lastFileRemaining}.checksum();
+        }
+
+        return checksum;
     }
 
-    int getLastFileBlock(int startIndex = -1) const {
-        int index = startIndex >= 0 ? startIndex : totalBlocks - 1;
-        while (index >= 0 && blocks[index] == -1) {
-            index--;
+    // moves every file once, highest id first, into the leftmost free span it fits in
+    // and returns the checksum of the result. The free spans are kept in one min-heap
+    // of start offsets per length, so the leftmost fitting span is the smallest top of
+    // the heaps for the file length and up
+    uint64_t compressFiles() const {
+        std::vector<DiskSpan> files = this->files;
+
+        std::array<std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<>>, 10> freeStarts;
+        for (const DiskSpan& span : freeSpans) {
+            freeStarts[span.length].push(span.start);
+        }
+
+        for (int fileID = files.size() - 1; fileID >= 0; fileID--) {
+            DiskSpan& file = files[fileID];
+            if (file.length <= 0)
+                continue;
+
+            int bestLength = -1;
+            for (int length = file.length; length < freeStarts.size(); length++) {
+                if (!freeStarts[length].empty() && freeStarts[length].top() < file.start && (bestLength < 0 || freeStarts[length].top() < freeStarts[bestLength].top())) {
+                    bestLength = length;
+                }
+            }
+
+            if (bestLength < 0)
+                continue;
+
+            uint64_t freeSpace = freeStarts[bestLength].top();
+            freeStarts[bestLength].pop();
+
+            // the space the file leaves behind is right of every file still to be moved
+            file.start = freeSpace;
+            if (bestLength > file.length) {
+                freeStarts[bestLength - file.length].push(freeSpace + file.length);
+            }
         }
 
-        return index;
+        return calculateChecksum(files);
     }
 
-    int getFileSize(unsigned int fileStart) const {
-        int size = 1;
-        int fileId = blocks[fileStart];
+    // the same as compressFiles, but walks the free spans from the left for every file
+    uint64_t compressFilesByScan() const {
+        std::vector<DiskSpan> files = this->files;
+        std::vector<DiskSpan> remaining = freeSpans;
 
-        while (fileStart + size < totalBlocks && blocks[fileStart + size] == fileId) {
-            size++;
+        for (int fileID = files.size() - 1; fileID >= 0; fileID--) {
+            DiskSpan& file = files[fileID];
+
+            for (DiskSpan& freeSpace : remaining) {
+                if (freeSpace.start >= file.start)
+                    break;
+
+                if (freeSpace.length >= file.length) {
+                    file.start = freeSpace.start;
+                    freeSpace.start += file.length;
+                    freeSpace.length -= file.length;
+                    break;
+                }
+            }
         }
 
-        return size;
+        return calculateChecksum(files);
     }
 
-    int getFileBlockByID(int fileID) const {
-        unsigned int fileStart = 0;
+    static uint64_t calculateChecksum(const std::vector<DiskSpan>& files) {
+        uint64_t checksum = 0;
 
-        while (blocks[fileStart] != fileID) {
-            fileStart++;
+        for (const DiskSpan& file : files) {
+            checksum += file.checksum();
         }
 
-        return fileStart;
+        return checksum;
     }
+};
 
-    // void compress() {
-    //     int freeBlock = getFirstFreeBlock();
-    //     int lastFileBlock = getLastFileBlock();
+// turns the digits into their values, 16 at a time where SSE2 is available
+void decodeDigits(const char* digits, std::size_t count, uint8_t* values) {
+    std::size_t i = 0;
 
-    //     while (freeBlock < lastFileBlock) {
-    //         blocks[freeBlock] = blocks[lastFileBlock];
-    //         blocks[lastFileBlock] = -1;
+#ifdef __SSE2__
+    const __m128i zero = _mm_set1_epi8('0');
+    for (; i + 16 <= count; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(digits + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), _mm_sub_epi8(chunk, zero));
+    }
+#endif
 
-    //         freeBlock = getFirstFreeBlock(freeBlock);
-    //         lastFileBlock = getLastFileBlock(lastFileBlock);
-    //     }
-    // }
+    for (; i < count; i++) {
+        values[i] = digits[i] - '0';
+    }
+}
 
-    void compress() {
-        int fileStart = getLastFileBlock();
-        int fileID = blocks[fileStart];
+// trailing characters that are not digits, usually the newline, are left out
+std::size_t countDigits(const char* data, std::size_t size) {
+    std::size_t count = size;
+    while (count > 0 && (data[count - 1] < '0' || data[count - 1] > '9')) {
+        count--;
+    }
 
-        while (fileID >= 0) {
-            fileStart = getFileBlockByID(fileID);
-            int fileSize = getFileSize(fileStart);
+    return count;
+}
 
-            unsigned int freeSpace = getFirstFreeBlock();
-            int freeSpaceSize = getFileSize(freeSpace);
+// maps the whole file into memory and decodes it in one go
+std::vector<uint8_t> readDiskMap(const std::string& filename) {
+    std::vector<uint8_t> diskMap;
 
-            while (freeSpace < fileStart && freeSpaceSize < fileSize) {
-                freeSpace = getFirstFreeBlock(freeSpace + freeSpaceSize);
-                freeSpaceSize = getFileSize(freeSpace);
-            }
+#ifdef _WIN32
+    std::ifstream file(filename, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 
-            if (freeSpaceSize >= fileSize && freeSpace < fileStart) {
-                // move file
-                for (int i = 0; i < fileSize; i++) {
-                    blocks[freeSpace + i] = fileID;
-                    blocks[fileStart + i] = -1;
-                }
-            }
+    diskMap.resize(countDigits(data.data(), data.size()));
+    decodeDigits(data.data(), diskMap.size(), diskMap.data());
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return diskMap;
 
-            fileID--;
-        }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size == 0) {
+        close(fd);
+        return diskMap;
     }
 
-    std::size_t calculateChecksum() const {
-        std::size_t checksum = 0;
+    void* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return diskMap;
 
-        for (int index = 0; index < totalBlocks; index++) {
-            if (blocks[index] == -1)
-                continue;
+    madvise(mapping, status.st_size, MADV_SEQUENTIAL);
 
-            checksum += index * blocks[index];
-        }
+    const char* data = static_cast<const char*>(mapping);
+    diskMap.resize(countDigits(data, status.st_size));
+    decodeDigits(data, diskMap.size(), diskMap.data());
 
-        return checksum;
-    }
-};
+    munmap(mapping, status.st_size);
+#endif
 
-int main(int argC, char** argV) {
-    std::vector<int> diskMap;
-    std::ifstream file("input.txt");
+    return diskMap;
+}
 
-    char current;
-    while (file.get(current)) {
-        diskMap.push_back(current - '0');
+int main(int argC, char** argV) {
+    bool scan = false;
+    bool blocks = false;
+    bool files = true;
+    for (int i = 1; i < argC; i++) {
+        std::string_view arg = argV[i];
+        if (arg == "--scan") {
+            scan = true;
+        }
+        else if (arg.starts_with("--mode=")) {
+            std::string_view mode = arg.substr(7);
+            blocks = mode == "blocks" || mode == "both";
+            files = mode == "files" || mode == "both";
+
+            if (!blocks && !files) {
+                std::cerr << "Unknown mode " << mode << std::endl;
+                return 1;
+            }
+        }
     }
-    file.close();
 
-    FileSystem fs = FileSystem(diskMap);
+    const FileSystem fs = FileSystem(readDiskMap("input.txt"));
 
-    fs.compress();
+    // both modes only read the parsed disk, so the block mode runs beside the file mode
+    uint64_t blocksChecksum = 0;
+    std::thread blocksThread;
+    if (blocks) {
+        blocksThread = std::thread([&fs, &blocksChecksum]() {
+            blocksChecksum = fs.compressBlocks();
+        });
+    }
 
-    std::size_t checksum = fs.calculateChecksum();
+    uint64_t filesChecksum = 0;
+    if (files) {
+        filesChecksum = scan ? fs.compressFilesByScan() : fs.compressFiles();
+    }
 
-    std::cout << "Compressed filesystem checksum: " << checksum << std::endl;
-}
\ No newline at end of file
+    if (blocks) {
+        blocksThread.join();
+        std::cout << "Block compressed filesystem checksum: " << blocksChecksum << std::endl;
+    }
+
+    if (files) {
+        std::cout << "Compressed filesystem checksum: " << filesChecksum << std::endl;
+    }
+}